@@ -0,0 +1,140 @@
+
+#include "./benchmark.hpp"
+#include "./render.hpp"
+#include "./pool.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+namespace {
+	// Keeps relMSE finite where the reference is black
+	constexpr double RELATIVE_EPSILON = 1e-2;
+	
+	template<class Error>
+	double meanError(const ImageRGBAF& image, const ImageRGBAF& reference, Error&& error){
+		assert(image.width() == reference.width() && image.height() == reference.height());
+		
+		const size_t count = image.width() * image.height();
+		double sum = 0;
+		
+		for(size_t i=0; i < count; ++i){
+			const PixelRGBAF& p = image.pixels()[i];
+			const PixelRGBAF& r = reference.pixels()[i];
+			sum += error(p.r, r.r) + error(p.g, r.g) + error(p.b, r.b);
+		}
+		
+		return sum / double(3 * count);
+	}
+	
+	bool endsWith(const std::string& s, const std::string& suffix){
+		return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+	}
+}
+
+double rootMeanSquaredError(const ImageRGBAF& image, const ImageRGBAF& reference){
+	return std::sqrt(meanError(image, reference, [](double value, double expected){
+		return (value - expected) * (value - expected);
+	}));
+}
+
+double relativeMeanSquaredError(const ImageRGBAF& image, const ImageRGBAF& reference){
+	return meanError(image, reference, [](double value, double expected){
+		return (value - expected) * (value - expected) / (expected * expected + RELATIVE_EPSILON);
+	});
+}
+
+std::vector<ConvergenceSample> measureConvergence(const Hittable& world, const Camera& camera, RenderPool& pool,
+												  const ImageRGBAF& reference, const BenchmarkSettings& settings){
+	using Clock = std::chrono::steady_clock;
+	
+	const size_t width = reference.width(), height = reference.height();
+	ImageRGBAF pass(width, height), sum(width, height), mean(width, height);
+	memset(sum.pixels(), 0, sizeof(PixelRGBAF) * width * height);
+	
+	std::vector<Tile> tiles;
+	generateTilesOfSize(tiles, width, height);
+	
+	std::vector<ConvergenceSample> samples;
+	Clock::duration elapsed = Clock::duration::zero();
+	const auto duration = std::chrono::duration<double>(settings.durationSeconds);
+	const auto interval = std::chrono::duration<double, std::milli>(settings.intervalMilliseconds);
+	auto nextSample = interval;
+	
+	const TileKernel kernel = selectKernel(kernelConfigFor(world, camera, settings.samplesPerPass, MAX_DEPTH));
+	
+	for(size_t samplesPerPixel=0; elapsed < duration;){
+		const auto passStart = Clock::now();
+		
+		pool.submit(tiles, [&](const Tile& tile){
+			kernel(pass, world, camera, tile, settings.samplesPerPass, MAX_DEPTH);
+			
+			for(size_t y=tile.yStart; y < tile.yStart + tile.height; ++y){
+				for(size_t x=tile.xStart; x < tile.xStart + tile.width; ++x){
+					const PixelRGBAF& p = pass.pixels()[y * width + x];
+					PixelRGBAF& s = sum.pixels()[y * width + x];
+					s.r += p.r * settings.samplesPerPass;
+					s.g += p.g * settings.samplesPerPass;
+					s.b += p.b * settings.samplesPerPass;
+				}
+			}
+		})->wait();
+		
+		elapsed += Clock::now() - passStart;
+		samplesPerPixel += settings.samplesPerPass;
+		
+		if( elapsed < nextSample && elapsed < duration )
+			continue;
+		
+		// The clock is stopped while measuring the error
+		for(size_t i=0; i < width * height; ++i){
+			const PixelRGBAF& s = sum.pixels()[i];
+			mean.pixels()[i] = {s.r / samplesPerPixel, s.g / samplesPerPixel, s.b / samplesPerPixel, 1.f};
+		}
+		
+		const ConvergenceSample sample = {
+			std::chrono::duration<double, std::milli>(elapsed).count(),
+			samplesPerPixel,
+			rootMeanSquaredError(mean, reference),
+			relativeMeanSquaredError(mean, reference),
+		};
+		
+		samples.push_back(sample);
+		printf("%8.0fms %6zuspp rmse %.6f relmse %.6f\n", sample.milliseconds, sample.samplesPerPixel, sample.rmse, sample.relMSE);
+		
+		if( sample.rmse <= settings.targetRMSE )
+			break;
+		
+		while( nextSample <= elapsed )
+			nextSample += interval;
+	}
+	
+	return samples;
+}
+
+bool writeConvergenceReport(const std::vector<ConvergenceSample>& samples, const std::string& path){
+	FILE *file = fopen(path.c_str(), "w");
+	if( file == nullptr )
+		return false;
+	
+	if( endsWith(path, ".json") ){
+		fprintf(file, "[\n");
+		
+		for(size_t i=0; i < samples.size(); ++i){
+			const ConvergenceSample& s = samples[i];
+			fprintf(file, "\t{\"ms\": %.3f, \"spp\": %zu, \"rmse\": %.9g, \"relmse\": %.9g}%s\n",
+					s.milliseconds, s.samplesPerPixel, s.rmse, s.relMSE, i + 1 < samples.size() ? "," : "");
+		}
+		
+		fprintf(file, "]\n");
+	} else {
+		fprintf(file, "ms,spp,rmse,relmse\n");
+		
+		for(const ConvergenceSample& s: samples)
+			fprintf(file, "%.3f,%zu,%.9g,%.9g\n", s.milliseconds, s.samplesPerPixel, s.rmse, s.relMSE);
+	}
+	
+	return fclose(file) == 0;
+}
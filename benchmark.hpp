@@ -0,0 +1,40 @@
+#ifndef benchmark_h
+#define benchmark_h
+
+#include "./image.hpp"
+#include "./camera.hpp"
+
+#include <vector>
+#include <string>
+
+struct Hittable;
+class RenderPool;
+
+struct ConvergenceSample {
+	double milliseconds; // render time only, measuring the error is not counted
+	size_t samplesPerPixel;
+	double rmse;
+	double relMSE;
+};
+
+struct BenchmarkSettings {
+	double durationSeconds = 10;
+	double intervalMilliseconds = 250;
+	double targetRMSE = 0;     // stops as soon as it is reached, 0 to run for the whole duration
+	size_t samplesPerPass = 1; // samples added to every pixel before checking the time
+};
+
+double rootMeanSquaredError(const ImageRGBAF& image, const ImageRGBAF& reference);
+
+// Mean of the squared errors relative to the squared reference values, which keeps dark regions from
+// being drowned out by bright ones
+double relativeMeanSquaredError(const ImageRGBAF& image, const ImageRGBAF& reference);
+
+// Renders world progressively, measuring the error of the image against the reference every interval
+std::vector<ConvergenceSample> measureConvergence(const Hittable& world, const Camera& camera, RenderPool& pool,
+												  const ImageRGBAF& reference, const BenchmarkSettings& settings);
+
+// Writes the samples as JSON if path ends with ".json", as CSV otherwise
+bool writeConvergenceReport(const std::vector<ConvergenceSample>& samples, const std::string& path);
+
+#endif /* benchmark_h */
@@ -0,0 +1,238 @@
+
+#include "./bvh.hpp"
+#include "./pool.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <cassert>
+
+namespace {
+	constexpr uint32_t BIN_COUNT = 16;
+	constexpr uint32_t MAX_LEAF_SIZE = 4;
+	constexpr float TRAVERSAL_COST = 1.f;
+	constexpr float INTERSECTION_COST = 1.f;
+	
+	struct Bin {
+		AABBf bounds = AABBf::empty();
+		uint32_t count = 0;
+	};
+}
+
+void BVH::build(const std::vector<AABBf>& primitiveBounds){
+	clear();
+	
+	if( primitiveBounds.empty() )
+		return;
+	
+	std::vector<AABBf> bounds = primitiveBounds;
+	std::vector<Vector3f> centers;
+	centers.reserve(bounds.size());
+	indexStorage_.reserve(bounds.size());
+	nodeStorage_.reserve(2 * bounds.size());
+	
+	for(uint32_t i=0; i < bounds.size(); ++i){
+		centers.push_back(bounds[i].center());
+		indexStorage_.push_back(i);
+	}
+	
+	buildNode(bounds, centers, 0, static_cast<uint32_t>(bounds.size()), 0);
+	
+	nodes_ = nodeStorage_.data();
+	nodeCount_ = nodeStorage_.size();
+	indices_ = indexStorage_.data();
+	indexCount_ = indexStorage_.size();
+}
+
+void BVH::clear(){
+	nodeStorage_.clear();
+	indexStorage_.clear();
+	nodes_ = nullptr;
+	nodeCount_ = 0;
+	indices_ = nullptr;
+	indexCount_ = 0;
+}
+
+void BVH::assign(const BVHNode *nodes, size_t nodeCount, const uint32_t *indices, size_t indexCount){
+	clear();
+	nodes_ = nodes;
+	nodeCount_ = nodeCount;
+	indices_ = indices;
+	indexCount_ = indexCount;
+}
+
+void BVH::detach(){
+	if( nodes_ == nodeStorage_.data() && indices_ == indexStorage_.data() )
+		return;
+	
+	nodeStorage_.assign(nodes_, nodes_ + nodeCount_);
+	indexStorage_.assign(indices_, indices_ + indexCount_);
+	nodes_ = nodeStorage_.data();
+	indices_ = indexStorage_.data();
+}
+
+void BVH::refit(const std::function<AABBf(uint32_t)>& primitiveBounds, RenderPool& pool){
+	if( empty() )
+		return;
+	
+	detach();
+	
+	// Split the tree breadth first into enough subtrees to keep the pool busy, each one a contiguous
+	// range of nodes. The inner nodes above them are refitted once they are all done.
+	const size_t targetCount = 4 * pool.size();
+	std::deque<uint32_t> subtrees = {0};
+	std::vector<uint32_t> top;
+	
+	for(size_t leaves=0; leaves < subtrees.size() && subtrees.size() < targetCount;){
+		const uint32_t node = subtrees.front();
+		
+		if( nodeStorage_[node].count > 0 ){
+			// Leaves cannot be split further, cycle them to the back
+			subtrees.pop_front();
+			subtrees.push_back(node);
+			++leaves;
+			continue;
+		}
+		
+		subtrees.pop_front();
+		top.push_back(node);
+		subtrees.push_back(node + 1);
+		subtrees.push_back(nodeStorage_[node].offset);
+	}
+	
+	const std::vector<uint32_t> roots(subtrees.begin(), subtrees.end());
+	
+	pool.submit(roots.size(), [&](size_t i){
+		// Children come after their parent, so a backward sweep refits them first
+		for(uint32_t node=subtreeEnd(roots[i]); node-- > roots[i];)
+			refitNode(node, primitiveBounds);
+	})->wait();
+	
+	std::sort(top.begin(), top.end());
+	
+	for(auto node=top.rbegin(); node != top.rend(); ++node)
+		refitNode(*node, primitiveBounds);
+}
+
+uint32_t BVH::subtreeEnd(uint32_t node) const {
+	while( nodes_[node].count == 0 )
+		node = nodes_[node].offset;
+	
+	return node + 1;
+}
+
+void BVH::refitNode(uint32_t node, const std::function<AABBf(uint32_t)>& primitiveBounds){
+	BVHNode& n = nodeStorage_[node];
+	n.bounds = AABBf::empty();
+	
+	if( n.count > 0 ){
+		for(uint32_t i=n.offset; i < n.offset + n.count; ++i)
+			n.bounds.extend(primitiveBounds(indexStorage_[i]));
+	} else {
+		n.bounds.extend(nodeStorage_[node + 1].bounds);
+		n.bounds.extend(nodeStorage_[n.offset].bounds);
+	}
+}
+
+size_t BVH::memoryUsage() const noexcept {
+	return nodeStorage_.capacity() * sizeof(BVHNode) + indexStorage_.capacity() * sizeof(uint32_t);
+}
+
+uint32_t BVH::buildNode(std::vector<AABBf>& bounds, std::vector<Vector3f>& centers, uint32_t first, uint32_t count, uint32_t depth){
+	assert(depth <= MAX_TREE_DEPTH);
+	const uint32_t index = static_cast<uint32_t>(nodeStorage_.size());
+	nodeStorage_.push_back({AABBf::empty(), first, count});
+	
+	AABBf nodeBounds = AABBf::empty();
+	AABBf centerBounds = AABBf::empty();
+	
+	for(uint32_t i=first; i < first + count; ++i){
+		nodeBounds.extend(bounds[i]);
+		centerBounds.extend(centers[i]);
+	}
+	
+	nodeStorage_[index].bounds = nodeBounds;
+	
+	// Only degenerate splits get this deep, what is left goes into one large leaf rather than overflow traversal
+	if( count <= MAX_LEAF_SIZE || depth == MAX_TREE_DEPTH )
+		return index;
+	
+	// Find the cheapest split among the bin boundaries of every axis
+	const Vector3f extent = centerBounds.max - centerBounds.min;
+	float bestCost = INTERSECTION_COST * count;
+	uint32_t bestAxis = 0, bestSplit = 0;
+	
+	for(uint32_t axis=0; axis < 3; ++axis){
+		if( extent[axis] <= 0.f )
+			continue;
+		
+		Bin bins[BIN_COUNT];
+		const float scale = BIN_COUNT / extent[axis];
+		
+		for(uint32_t i=first; i < first + count; ++i){
+			const uint32_t b = std::min(BIN_COUNT - 1, static_cast<uint32_t>((centers[i][axis] - centerBounds.min[axis]) * scale));
+			bins[b].bounds.extend(bounds[i]);
+			++bins[b].count;
+		}
+		
+		float rightArea[BIN_COUNT];
+		uint32_t rightCount[BIN_COUNT];
+		AABBf right = AABBf::empty();
+		uint32_t rightSum = 0;
+		
+		for(uint32_t b=BIN_COUNT - 1; b > 0; --b){
+			right.extend(bins[b].bounds);
+			rightSum += bins[b].count;
+			rightArea[b] = right.surfaceArea();
+			rightCount[b] = rightSum;
+		}
+		
+		AABBf left = AABBf::empty();
+		uint32_t leftSum = 0;
+		
+		for(uint32_t split=1; split < BIN_COUNT; ++split){
+			left.extend(bins[split - 1].bounds);
+			leftSum += bins[split - 1].count;
+			
+			if( leftSum == 0 || rightCount[split] == 0 )
+				continue;
+			
+			const float cost = TRAVERSAL_COST + INTERSECTION_COST *
+				(left.surfaceArea() * leftSum + rightArea[split] * rightCount[split]) / nodeBounds.surfaceArea();
+			
+			if( cost < bestCost ){
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = split;
+			}
+		}
+	}
+	
+	uint32_t middle;
+	
+	if( bestSplit > 0 ){
+		const float scale = BIN_COUNT / extent[bestAxis];
+		middle = first;
+		
+		for(uint32_t i=first; i < first + count; ++i){
+			const uint32_t b = std::min(BIN_COUNT - 1, static_cast<uint32_t>((centers[i][bestAxis] - centerBounds.min[bestAxis]) * scale));
+			
+			if( b < bestSplit ){
+				std::swap(bounds[i], bounds[middle]);
+				std::swap(centers[i], centers[middle]);
+				std::swap(indexStorage_[i], indexStorage_[middle]);
+				++middle;
+			}
+		}
+	} else if( count > 2 * MAX_LEAF_SIZE ){
+		// No split beats a leaf but it would be too large, fall back to halving the primitives
+		middle = first + count / 2;
+	} else {
+		return index;
+	}
+	
+	assert(middle > first && middle < first + count);
+	nodeStorage_[index].count = 0;
+	buildNode(bounds, centers, first, middle - first, depth + 1);
+	nodeStorage_[index].offset = buildNode(bounds, centers, middle, first + count - middle, depth + 1);
+	return index;
+}
@@ -0,0 +1,123 @@
+#ifndef bvh_h
+#define bvh_h
+
+#include "./math.hpp"
+#include "./instrument.hpp"
+
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+class RenderPool;
+
+struct BVHNode {
+	AABBf bounds;
+	uint32_t offset; // leaves: first entry in the primitive indices, inner nodes: index of the second child
+	uint32_t count;  // primitives in a leaf, 0 for inner nodes whose first child directly follows them
+};
+
+// Bounding volume hierarchy over primitives known only by their bounds, built with binned SAH.
+// Nodes are stored depth first so it can be traversed, and later saved, as a flat array.
+class BVH {
+public:
+	// Inner nodes on the way from the root to any node, which bounds the stack traversal needs
+	static constexpr uint32_t MAX_TREE_DEPTH = 64;
+	
+	BVH() = default;
+	BVH(const BVH&) = delete;
+	BVH& operator=(const BVH&) = delete;
+	
+	void build(const std::vector<AABBf>& primitiveBounds);
+	void clear();
+	
+	// Uses nodes and indices stored elsewhere, such as in a mapped file, which must outlive the BVH
+	void assign(const BVHNode *nodes, size_t nodeCount, const uint32_t *indices, size_t indexCount);
+	
+	// Copies assigned nodes and indices so that the BVH no longer depends on them
+	void detach();
+	
+	// Recomputes the node bounds after primitives moved, keeping the tree as it is.
+	// Independent subtrees are refitted concurrently on the pool.
+	void refit(const std::function<AABBf(uint32_t)>& primitiveBounds, RenderPool& pool);
+	
+	bool empty() const noexcept { return nodeCount_ == 0; }
+	const BVHNode* nodes() const noexcept { return nodes_; }
+	size_t nodeCount() const noexcept { return nodeCount_; }
+	const uint32_t* indices() const noexcept { return indices_; }
+	size_t indexCount() const noexcept { return indexCount_; }
+	size_t memoryUsage() const noexcept;
+	
+	// Calls hitPrimitive(index, tMin, tMax) for the primitives the ray might hit, nearest nodes first.
+	// hitPrimitive returns the distance of a closer hit, which narrows the search, or tMax.
+	template<class HitPrimitive>
+	bool hit(const Rayf& r, float tMin, float tMax, HitPrimitive&& hitPrimitive) const;
+	
+private:
+	uint32_t buildNode(std::vector<AABBf>& bounds, std::vector<Vector3f>& centers, uint32_t first, uint32_t count, uint32_t depth);
+	uint32_t subtreeEnd(uint32_t node) const;
+	void refitNode(uint32_t node, const std::function<AABBf(uint32_t)>& primitiveBounds);
+	
+	std::vector<BVHNode> nodeStorage_;
+	std::vector<uint32_t> indexStorage_;
+	const BVHNode *nodes_ = nullptr;
+	size_t nodeCount_ = 0;
+	const uint32_t *indices_ = nullptr;
+	size_t indexCount_ = 0;
+};
+
+template<class HitPrimitive>
+bool BVH::hit(const Rayf& r, float tMin, float tMax, HitPrimitive&& hitPrimitive) const {
+	if( nodeCount_ == 0 )
+		return false;
+	
+	const Vector3f invDirection = {1.f / r.direction.x, 1.f / r.direction.y, 1.f / r.direction.z};
+	uint32_t stack[MAX_TREE_DEPTH];
+	size_t stackSize = 0;
+	bool didHit = false;
+	
+	RT_COUNT(boxTests);
+	if( !nodes_[0].bounds.hit(r, invDirection, tMin, tMax) )
+		return false;
+	
+	for(uint32_t current=0;;){
+		const BVHNode& node = nodes_[current];
+		
+		if( node.count > 0 ){
+			for(uint32_t i=node.offset; i < node.offset + node.count; ++i){
+				RT_COUNT(primitiveTests);
+				const float t = hitPrimitive(indices_[i], tMin, tMax);
+				
+				if( t < tMax ){
+					tMax = t;
+					didHit = true;
+				}
+			}
+		} else {
+			const uint32_t first = current + 1;
+			const uint32_t second = node.offset;
+			RT_ADD(boxTests, 2);
+			const bool hitFirst = nodes_[first].bounds.hit(r, invDirection, tMin, tMax);
+			const bool hitSecond = nodes_[second].bounds.hit(r, invDirection, tMin, tMax);
+			
+			if( hitFirst && hitSecond ){
+				// Visit the child nearest along the ray first so that farther hits get culled
+				const bool firstIsNearer = dot(nodes_[first].bounds.center() - nodes_[second].bounds.center(), r.direction) < 0;
+				current = firstIsNearer ? first : second;
+				stack[stackSize++] = firstIsNearer ? second : first;
+				continue;
+			} else if( hitFirst || hitSecond ){
+				current = hitFirst ? first : second;
+				continue;
+			}
+		}
+		
+		if( stackSize == 0 )
+			break;
+		
+		current = stack[--stackSize];
+	}
+	
+	return didHit;
+}
+
+#endif /* bvh_h */
@@ -0,0 +1,72 @@
+
+#include "./cache.hpp"
+
+std::shared_ptr<Scene> SceneCache::acquire(const std::string& id){
+	std::unique_lock<std::mutex> lk(lock_);
+	auto it = entries_.find(id);
+	
+	// Renders still holding the stale scene keep it alive until they finish
+	if( it != entries_.end() && it->second.memoryUsage > 0 && it->second.scene.get()->stale() ){
+		used_ -= it->second.memoryUsage;
+		lru_.erase(it->second.lru);
+		entries_.erase(it);
+		it = entries_.end();
+	}
+	
+	if( it != entries_.end() ){
+		lru_.splice(lru_.begin(), lru_, it->second.lru);
+		std::shared_future<std::shared_ptr<Scene>> scene = it->second.scene;
+		lk.unlock();
+		return scene.get();
+	}
+	
+	// Load outside of the lock so that renders of cached scenes are not held up
+	std::promise<std::shared_ptr<Scene>> promise;
+	lru_.push_front(id);
+	
+	Entry& entry = entries_[id];
+	entry.scene = promise.get_future().share();
+	entry.lru = lru_.begin();
+	lk.unlock();
+	
+	std::shared_ptr<Scene> scene = loadScene(id);
+	promise.set_value(scene);
+	
+	lk.lock();
+	it = entries_.find(id);
+	
+	if( scene == nullptr ){
+		lru_.erase(it->second.lru);
+		entries_.erase(it);
+	} else {
+		it->second.memoryUsage = scene->memoryUsage;
+		used_ += scene->memoryUsage;
+		evict();
+	}
+	
+	return scene;
+}
+
+size_t SceneCache::memoryUsage(){
+	std::lock_guard<std::mutex> lg(lock_);
+	return used_;
+}
+
+void SceneCache::evict(){
+	if( lru_.empty() )
+		return;
+	
+	// The most recently used scene is always kept, even if it alone exceeds the budget
+	for(auto it=std::prev(lru_.end()); used_ > budget_ && it != lru_.begin();){
+		auto entry = entries_.find(*it);
+		auto previous = std::prev(it);
+		
+		if( entry->second.memoryUsage > 0 ){
+			used_ -= entry->second.memoryUsage;
+			entries_.erase(entry);
+			lru_.erase(it);
+		}
+		
+		it = previous;
+	}
+}
@@ -0,0 +1,42 @@
+#ifndef cache_h
+#define cache_h
+
+#include "./scene.hpp"
+
+#include <memory>
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <future>
+#include <mutex>
+
+// Keeps loaded scenes resident between renders, evicting the least recently used ones once their total
+// memory usage goes over the budget. Scenes still in use by a render stay alive until it finishes.
+class SceneCache {
+public:
+	explicit SceneCache(size_t memoryBudget): budget_(memoryBudget) {}
+	
+	// Returns the cached scene or loads it, nullptr if the id is unknown. Scenes whose description changed
+	// since they were cached are loaded again. Concurrent requests for a scene being loaded wait for that
+	// load instead of starting their own.
+	std::shared_ptr<Scene> acquire(const std::string& id);
+	
+	size_t memoryUsage();
+	
+private:
+	struct Entry {
+		std::shared_future<std::shared_ptr<Scene>> scene;
+		std::list<std::string>::iterator lru;
+		size_t memoryUsage = 0; // 0 while loading
+	};
+	
+	void evict();
+	
+	const size_t budget_;
+	size_t used_ = 0;
+	std::unordered_map<std::string, Entry> entries_;
+	std::list<std::string> lru_; // most recently used first
+	std::mutex lock_;
+};
+
+#endif /* cache_h */
@@ -1,6 +1,8 @@
 
 #include "./camera.hpp"
 
+#include <algorithm>
+
 Camera::Camera(Vector3f lookFrom, Vector3f lookAt, Vector3f up, 
 			   float degVerticalFov, float aspect, 
 			   float aperture, float focusDistance){
@@ -20,12 +22,31 @@ Camera::Camera(Vector3f lookFrom, Vector3f lookAt, Vector3f up,
 	vertical = 2 * halfHeight * focusDistance * v;
 }
 
-Rayf Camera::rayFor(Vector2f uv) const {
-	Vector3f rd = lensRadius * randomInUnitDisk<float>();
-	Vector3f offset = u * rd.x + v * rd.y;
+// MARK: - RayDifferential
+namespace {
+	// Where the ray crosses the plane through point, or its origin when parallel to it
+	Vector3f crossing(const Rayf& r, const Vector3f& point, const Vector3f& normal){
+		const float d = dot(normal, r.direction);
+		
+		if( std::abs(d) < 1e-8f )
+			return r.origin;
+		
+		return r.pointAt(dot(normal, point - r.origin) / d);
+	}
+}
+
+float RayDifferential::footprint(const Vector3f& point, const Vector3f& normal) const {
+	return std::max((crossing(x, point, normal) - point).length(), (crossing(y, point, normal) - point).length());
+}
+
+RayDifferential RayDifferential::scattered(const Rayf& in, const Rayf& out, const Vector3f& normal) const {
+	const float inLength = in.direction.length();
+	const float outLength = out.direction.length();
 	
-	return Rayf{
-		origin + offset,
-		lowerLeftCorner + uv.x * horizontal + uv.y * vertical - origin - offset
+	const auto follow = [&](const Rayf& offset){
+		const Vector3f spread = offset.direction / offset.direction.length() - in.direction / inLength;
+		return Rayf{crossing(offset, out.origin, normal), out.direction + outLength * spread};
 	};
+	
+	return {follow(x), follow(y)};
 }
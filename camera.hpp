@@ -3,16 +3,54 @@
 
 #include "./math.hpp"
 
+// Rays through the next pixel over and the next one up, which bound the area a ray sees for texture filtering
+struct RayDifferential {
+	Rayf x, y;
+	
+	// Width of the footprint at point, on the plane with the given normal
+	float footprint(const Vector3f& point, const Vector3f& normal) const;
+	
+	// Follows a ray scattered off the surface, keeping the footprint at the scattering point and the
+	// angle between the rays
+	RayDifferential scattered(const Rayf& in, const Rayf& out, const Vector3f& normal) const;
+};
+
 struct Camera {
 	Vector3f origin, lowerLeftCorner, horizontal, vertical;
 	Vector3f u, v, w;
 	float lensRadius;
 	
+	Camera() = default;
 	Camera(Vector3f lookFrom, Vector3f lookAt, Vector3f up, 
 		   float degVerticalFov, float aspect, 
 		   float aperture, float focusDistance);
 	
-	Rayf rayFor(Vector2f uv) const;
+	// pixelSize is the distance between pixels in uv, 1 over the image size. Without Lens the aperture is
+	// ignored, which only pinhole cameras can afford; without Differentials the differential is left alone.
+	template<bool Lens = true, bool Differentials = true>
+	Rayf rayFor(Vector2f uv, Vector2f pixelSize, RayDifferential& differential) const;
 };
 
+template<bool Lens, bool Differentials>
+Rayf Camera::rayFor(Vector2f uv, Vector2f pixelSize, RayDifferential& differential) const {
+	Vector3f offset = {0, 0, 0};
+	
+	if( Lens ){
+		const Vector3f rd = lensRadius * randomInUnitDisk<float>();
+		offset = u * rd.x + v * rd.y;
+	}
+	
+	const Rayf ray = {
+		origin + offset,
+		lowerLeftCorner + uv.x * horizontal + uv.y * vertical - origin - offset
+	};
+	
+	if( Differentials ){
+		differential.x = {ray.origin, ray.direction + pixelSize.x * horizontal};
+		differential.y = {ray.origin, ray.direction + pixelSize.y * vertical};
+	}
+	
+	return ray;
+}
+
 #endif /* camera_h */
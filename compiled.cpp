@@ -0,0 +1,590 @@
+
+#include "./compiled.hpp"
+#include "./material.hpp"
+#include "./pool.hpp"
+#include "./texture.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <type_traits>
+#include <algorithm>
+
+namespace {
+	const char MAGIC[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', 0};
+	constexpr uint32_t VERSION = 3;
+	constexpr uint64_t SECTION_ALIGNMENT = 16;
+	
+	struct FileHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t byteOrder;
+		uint32_t textureSize, materialSize, primitiveSize, nodeSize, headerSize;
+		SourceStamp source;
+		CameraSettings camera;
+		uint64_t textureOffset, textureCount;
+		uint64_t materialOffset, materialCount;
+		uint64_t primitiveOffset, primitiveCount;
+		uint64_t nodeOffset, nodeCount;
+		uint64_t indexOffset, indexCount;
+		uint64_t objectOffset, objectCount;
+		uint64_t objectKeyOffset, objectKeyCount;
+		uint64_t cameraKeyOffset, cameraKeyCount;
+	};
+	
+	static_assert(std::is_trivially_copyable<FileHeader>::value, "compiled scenes are saved as raw bytes");
+	static_assert(std::is_trivially_copyable<ScenePrimitive>::value, "compiled scenes are saved as raw bytes");
+	static_assert(std::is_trivially_copyable<SceneTexture>::value, "compiled scenes are saved as raw bytes");
+	static_assert(std::is_trivially_copyable<SceneMaterial>::value, "compiled scenes are saved as raw bytes");
+	static_assert(std::is_trivially_copyable<BVHNode>::value, "compiled scenes are saved as raw bytes");
+	static_assert(std::is_trivially_copyable<SceneObject>::value, "compiled scenes are saved as raw bytes");
+	static_assert(std::is_trivially_copyable<ObjectKeyframe>::value, "compiled scenes are saved as raw bytes");
+	static_assert(std::is_trivially_copyable<CameraKeyframe>::value, "compiled scenes are saved as raw bytes");
+	
+	uint64_t align(uint64_t offset){
+		return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+	}
+	
+	bool validSection(uint64_t offset, uint64_t count, size_t elementSize, size_t fileSize){
+		return offset % SECTION_ALIGNMENT == 0 && offset <= fileSize &&
+			   count <= (fileSize - offset) / elementSize;
+	}
+	
+	template<class T>
+	std::vector<T> copySection(const char *bytes, uint64_t offset, uint64_t count){
+		const T *begin = reinterpret_cast<const T*>(bytes + offset);
+		return std::vector<T>(begin, begin + count);
+	}
+	
+	// Finds the keys around time among keys sorted by time, and how far between them time is
+	template<class Key>
+	void bracket(const Key *begin, const Key *end, float time, const Key*& before, const Key*& after, float& t){
+		after = std::lower_bound(begin, end, time, [](const Key& key, float time){ return key.time < time; });
+		t = 0.f;
+		
+		if( after == begin ){
+			before = after;
+		} else if( after == end ){
+			before = after = end - 1;
+		} else {
+			before = after - 1;
+			t = (time - before->time) / (after->time - before->time);
+		}
+	}
+	
+	Vector3f rotateY(const Vector3f& v, float c, float s){
+		return {c * v.x + s * v.z, v.y, -s * v.x + c * v.z};
+	}
+}
+
+// MARK: - ScenePrimitive
+ScenePrimitive ScenePrimitive::sphere(const Vector3f& center, float radius, uint32_t material) noexcept {
+	return {center, {0, 0, 0}, {0, 0, 0}, radius, material};
+}
+
+ScenePrimitive ScenePrimitive::triangle(const Vector3f& v0, const Vector3f& v1, const Vector3f& v2, uint32_t material) noexcept {
+	return {v0, v1 - v0, v2 - v0, 0.f, material};
+}
+
+AABBf ScenePrimitive::bounds() const noexcept {
+	if( isSphere() ){
+		const Vector3f extent = {radius, radius, radius};
+		return {a - extent, a + extent};
+	}
+	
+	AABBf result = AABBf::empty();
+	result.extend(a);
+	result.extend(a + e1);
+	result.extend(a + e2);
+	return result;
+}
+
+float ScenePrimitive::uvScale() const noexcept {
+	return isSphere() ? float(M_PI) * radius : std::sqrt(cross(e1, e2).length());
+}
+
+bool ScenePrimitive::hit(const Rayf& r, float tMin, float tMax, float& t, Vector3f& normal, Vector2f& uv) const noexcept {
+	if( isSphere() ){
+		const Vector3f oc = r.origin - a;
+		const float qa = dot(r.direction, r.direction);
+		const float qb = 2.0f * dot(oc, r.direction);
+		const float qc = dot(oc, oc) - radius * radius;
+		const float discriminant = qb * qb - 4 * qa * qc;
+		
+		if( discriminant <= 0 )
+			return false;
+		
+		t = (-qb - sqrt(discriminant)) / (2.f * qa);
+		
+		if( t >= tMax || t <= tMin )
+			t = (-qb + sqrt(discriminant)) / (2.f * qa);
+		
+		if( t >= tMax || t <= tMin )
+			return false;
+		
+		normal = (r.pointAt(t) - a) / radius;
+		uv = sphereUV(normal);
+		return true;
+	}
+	
+	// Möller-Trumbore
+	const Vector3f p = cross(r.direction, e2);
+	const float determinant = dot(e1, p);
+	
+	if( std::abs(determinant) < 1e-12f )
+		return false;
+	
+	const float invDeterminant = 1.f / determinant;
+	const Vector3f s = r.origin - a;
+	const float u = dot(s, p) * invDeterminant;
+	
+	if( u < 0.f || u > 1.f )
+		return false;
+	
+	const Vector3f q = cross(s, e1);
+	const float v = dot(r.direction, q) * invDeterminant;
+	
+	if( v < 0.f || u + v > 1.f )
+		return false;
+	
+	t = dot(e2, q) * invDeterminant;
+	
+	if( t >= tMax || t <= tMin )
+		return false;
+	
+	normal = cross(e1, e2).normalized();
+	uv = {u, v};
+	return true;
+}
+
+// MARK: - CompiledScene
+CompiledScene::CompiledScene(): Hittable(nullptr) {
+}
+
+CompiledScene::CompiledScene(SceneContents contents)
+: Hittable(nullptr), camera_(contents.camera),
+  objects_(std::move(contents.objects)), objectKeys_(std::move(contents.objectKeys)), cameraKeys_(std::move(contents.cameraKeys)),
+  textureStorage_(std::move(contents.textures)), materialStorage_(std::move(contents.materials)),
+  primitiveStorage_(std::move(contents.primitives)) {
+	textures_ = textureStorage_.data();
+	textureCount_ = textureStorage_.size();
+	materials_ = materialStorage_.data();
+	materialCount_ = materialStorage_.size();
+	primitives_ = primitiveStorage_.data();
+	primitiveCount_ = primitiveStorage_.size();
+	
+	std::vector<AABBf> primitiveBounds;
+	primitiveBounds.reserve(primitiveCount_);
+	
+	for(size_t i=0; i < primitiveCount_; ++i){
+		assert(primitives_[i].material < materialCount_);
+		primitiveBounds.push_back(primitives_[i].bounds());
+	}
+	
+	bvh_.build(primitiveBounds);
+	createMaterials();
+	sortKeyframes();
+}
+
+CompiledScene::~CompiledScene(){
+	bvh_.clear();
+	
+	if( mapping_ != nullptr )
+		munmap(mapping_, mappingSize_);
+}
+
+void CompiledScene::sortKeyframes(){
+	std::stable_sort(objectKeys_.begin(), objectKeys_.end(), [](const ObjectKeyframe& a, const ObjectKeyframe& b){
+		return a.object < b.object || (a.object == b.object && a.time < b.time);
+	});
+	
+	std::stable_sort(cameraKeys_.begin(), cameraKeys_.end(), [](const CameraKeyframe& a, const CameraKeyframe& b){
+		return a.time < b.time;
+	});
+}
+
+void CompiledScene::createMaterials(){
+	materialObjects_.clear();
+	textureObjects_.clear();
+	
+	// Images are only mapped here, their tiles get read as they are sampled. Missing ones leave the albedo alone.
+	for(size_t i=0; i < textureCount_; ++i){
+		const SceneTexture& t = textures_[i];
+		
+		switch(t.type){
+			case TextureType::Image:
+				textureObjects_.push_back(TextureCache::shared().load(t.path));
+				if( textureObjects_.back() == nullptr )
+					fprintf(stderr, "could not load the texture '%s'\n", t.path);
+				break;
+			case TextureType::Checker:
+				textureObjects_.push_back(std::make_shared<CheckerTexture>(t.even, t.odd, t.frequency));
+				break;
+		}
+	}
+	
+	for(size_t i=0; i < materialCount_; ++i){
+		const SceneMaterial& m = materials_[i];
+		const std::shared_ptr<const Texture> texture = m.texture == NO_TEXTURE ? nullptr : textureObjects_[m.texture];
+		
+		switch(m.type){
+			case MaterialType::Diffuse:
+				materialObjects_.emplace_back(new DiffuseMaterial(m.albedo, texture));
+				break;
+			case MaterialType::Metal:
+				materialObjects_.emplace_back(new MetalMaterial(m.albedo, m.fuzziness, texture));
+				break;
+			case MaterialType::Dielectric:
+				materialObjects_.emplace_back(new DielectricMaterial(m.refractiveIndex));
+				break;
+		}
+	}
+}
+
+std::unique_ptr<CompiledScene> CompiledScene::map(const std::string& path, const SourceStamp& source){
+	const int fd = open(path.c_str(), O_RDONLY);
+	if( fd < 0 )
+		return nullptr;
+	
+	struct stat info;
+	void *mapping = MAP_FAILED;
+	size_t size = 0;
+	
+	if( fstat(fd, &info) == 0 && size_t(info.st_size) >= sizeof(FileHeader) ){
+		size = size_t(info.st_size);
+		mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	
+	close(fd);
+	
+	if( mapping == MAP_FAILED )
+		return nullptr;
+	
+	std::unique_ptr<CompiledScene> scene(new CompiledScene());
+	scene->mapping_ = mapping;
+	scene->mappingSize_ = size;
+	
+	const char *bytes = static_cast<const char*>(mapping);
+	FileHeader header;
+	memcpy(&header, bytes, sizeof(header));
+	
+	const bool valid =
+		memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+		header.version == VERSION &&
+		header.byteOrder == 0x01020304 &&
+		header.headerSize == sizeof(FileHeader) &&
+		header.textureSize == sizeof(SceneTexture) &&
+		header.materialSize == sizeof(SceneMaterial) &&
+		header.primitiveSize == sizeof(ScenePrimitive) &&
+		header.nodeSize == sizeof(BVHNode) &&
+		header.source == source &&
+		validSection(header.textureOffset, header.textureCount, sizeof(SceneTexture), size) &&
+		validSection(header.materialOffset, header.materialCount, sizeof(SceneMaterial), size) &&
+		validSection(header.primitiveOffset, header.primitiveCount, sizeof(ScenePrimitive), size) &&
+		validSection(header.nodeOffset, header.nodeCount, sizeof(BVHNode), size) &&
+		validSection(header.indexOffset, header.indexCount, sizeof(uint32_t), size) &&
+		validSection(header.objectOffset, header.objectCount, sizeof(SceneObject), size) &&
+		validSection(header.objectKeyOffset, header.objectKeyCount, sizeof(ObjectKeyframe), size) &&
+		validSection(header.cameraKeyOffset, header.cameraKeyCount, sizeof(CameraKeyframe), size) &&
+		header.indexCount == header.primitiveCount &&
+		(header.nodeCount > 0) == (header.primitiveCount > 0);
+	
+	if( !valid )
+		return nullptr;
+	
+	scene->camera_ = header.camera;
+	scene->textures_ = reinterpret_cast<const SceneTexture*>(bytes + header.textureOffset);
+	scene->textureCount_ = header.textureCount;
+	scene->materials_ = reinterpret_cast<const SceneMaterial*>(bytes + header.materialOffset);
+	scene->materialCount_ = header.materialCount;
+	scene->primitives_ = reinterpret_cast<const ScenePrimitive*>(bytes + header.primitiveOffset);
+	scene->primitiveCount_ = header.primitiveCount;
+	
+	const BVHNode *nodes = reinterpret_cast<const BVHNode*>(bytes + header.nodeOffset);
+	const uint32_t *indices = reinterpret_cast<const uint32_t*>(bytes + header.indexOffset);
+	
+	// Cheap checks that keep a damaged file from sending traversal out of bounds
+	for(size_t i=0; i < header.textureCount; ++i){
+		const SceneTexture& texture = scene->textures_[i];
+		
+		if( texture.type > TextureType::Checker || memchr(texture.path, 0, sizeof(texture.path)) == nullptr )
+			return nullptr;
+	}
+	
+	for(size_t i=0; i < header.materialCount; ++i){
+		const SceneMaterial& material = scene->materials_[i];
+		
+		if( material.type > MaterialType::Dielectric || (material.texture != NO_TEXTURE && material.texture >= header.textureCount) )
+			return nullptr;
+	}
+	
+	for(size_t i=0; i < header.primitiveCount; ++i){
+		if( scene->primitives_[i].material >= header.materialCount || indices[i] >= header.primitiveCount )
+			return nullptr;
+	}
+	
+	// Children always follow their parent, so one pass in order finds the depth of every node
+	std::vector<uint32_t> depths(header.nodeCount, 0);
+	
+	for(size_t i=0; i < header.nodeCount; ++i){
+		const BVHNode& node = nodes[i];
+		const bool validLeaf = node.count > 0 && uint64_t(node.offset) + node.count <= header.indexCount;
+		const bool validInner = node.count == 0 && node.offset > i + 1 && node.offset < header.nodeCount &&
+								depths[i] < BVH::MAX_TREE_DEPTH;
+		
+		if( !validLeaf && !validInner )
+			return nullptr;
+		
+		if( validInner ){
+			depths[i + 1] = std::max(depths[i + 1], depths[i] + 1);
+			depths[node.offset] = std::max(depths[node.offset], depths[i] + 1);
+		}
+	}
+	
+	scene->objects_ = copySection<SceneObject>(bytes, header.objectOffset, header.objectCount);
+	scene->objectKeys_ = copySection<ObjectKeyframe>(bytes, header.objectKeyOffset, header.objectKeyCount);
+	scene->cameraKeys_ = copySection<CameraKeyframe>(bytes, header.cameraKeyOffset, header.cameraKeyCount);
+	
+	for(const SceneObject& object: scene->objects_){
+		if( uint64_t(object.firstPrimitive) + object.primitiveCount > header.primitiveCount )
+			return nullptr;
+	}
+	
+	for(const ObjectKeyframe& key: scene->objectKeys_){
+		if( key.object >= scene->objects_.size() )
+			return nullptr;
+	}
+	
+	scene->bvh_.assign(nodes, header.nodeCount, indices, header.indexCount);
+	scene->createMaterials();
+	scene->sortKeyframes();
+	return scene;
+}
+
+bool CompiledScene::save(const std::string& path, const SourceStamp& source) const {
+	FileHeader header;
+	memset(static_cast<void*>(&header), 0, sizeof(header));
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.byteOrder = 0x01020304;
+	header.headerSize = sizeof(FileHeader);
+	header.textureSize = sizeof(SceneTexture);
+	header.materialSize = sizeof(SceneMaterial);
+	header.primitiveSize = sizeof(ScenePrimitive);
+	header.nodeSize = sizeof(BVHNode);
+	header.source = source;
+	header.camera = camera_;
+	
+	header.textureOffset = align(sizeof(FileHeader));
+	header.textureCount = textureCount_;
+	header.materialOffset = align(header.textureOffset + textureCount_ * sizeof(SceneTexture));
+	header.materialCount = materialCount_;
+	header.primitiveOffset = align(header.materialOffset + materialCount_ * sizeof(SceneMaterial));
+	header.primitiveCount = primitiveCount_;
+	header.nodeOffset = align(header.primitiveOffset + primitiveCount_ * sizeof(ScenePrimitive));
+	header.nodeCount = bvh_.nodeCount();
+	header.indexOffset = align(header.nodeOffset + bvh_.nodeCount() * sizeof(BVHNode));
+	header.indexCount = bvh_.indexCount();
+	header.objectOffset = align(header.indexOffset + bvh_.indexCount() * sizeof(uint32_t));
+	header.objectCount = objects_.size();
+	header.objectKeyOffset = align(header.objectOffset + objects_.size() * sizeof(SceneObject));
+	header.objectKeyCount = objectKeys_.size();
+	header.cameraKeyOffset = align(header.objectKeyOffset + objectKeys_.size() * sizeof(ObjectKeyframe));
+	header.cameraKeyCount = cameraKeys_.size();
+	
+	// Write next to the destination and move it in place, so concurrent readers never see a partial file
+	const std::string temporaryPath = path + ".tmp" + std::to_string(getpid());
+	FILE *file = fopen(temporaryPath.c_str(), "wb");
+	if( file == nullptr )
+		return false;
+	
+	uint64_t written = 0;
+	bool success = true;
+	
+	const auto write = [&](uint64_t offset, const void *data, size_t size){
+		static const char padding[SECTION_ALIGNMENT] = {};
+		success = success && fwrite(padding, 1, offset - written, file) == offset - written;
+		written = offset;
+		
+		// Empty sections may have no storage at all, and fwrite must not be given a null pointer
+		if( size == 0 )
+			return;
+		
+		success = success && fwrite(data, 1, size, file) == size;
+		written += size;
+	};
+	
+	write(0, &header, sizeof(header));
+	write(header.textureOffset, textures_, textureCount_ * sizeof(SceneTexture));
+	write(header.materialOffset, materials_, materialCount_ * sizeof(SceneMaterial));
+	write(header.primitiveOffset, primitives_, primitiveCount_ * sizeof(ScenePrimitive));
+	write(header.nodeOffset, bvh_.nodes(), bvh_.nodeCount() * sizeof(BVHNode));
+	write(header.indexOffset, bvh_.indices(), bvh_.indexCount() * sizeof(uint32_t));
+	write(header.objectOffset, objects_.data(), objects_.size() * sizeof(SceneObject));
+	write(header.objectKeyOffset, objectKeys_.data(), objectKeys_.size() * sizeof(ObjectKeyframe));
+	write(header.cameraKeyOffset, cameraKeys_.data(), cameraKeys_.size() * sizeof(CameraKeyframe));
+	
+	success = (fclose(file) == 0) && success && rename(temporaryPath.c_str(), path.c_str()) == 0;
+	
+	if( !success )
+		unlink(temporaryPath.c_str());
+	
+	return success;
+}
+
+bool CompiledScene::hit(const Rayf& r, float tMin, float tMax, Hit& hit) const {
+	float closest = tMax;
+	uint32_t closestIndex = 0;
+	Vector3f closestNormal;
+	Vector2f closestUV;
+	
+	const auto hitPrimitive = [&](uint32_t index, float tMin, float tMax){
+		float t;
+		Vector3f normal;
+		Vector2f uv;
+		
+		if( primitives_[index].hit(r, tMin, tMax, t, normal, uv) ){
+			closest = t;
+			closestIndex = index;
+			closestNormal = normal;
+			closestUV = uv;
+			return t;
+		}
+		
+		return tMax;
+	};
+	
+	if( !bvh_.hit(r, tMin, tMax, hitPrimitive) )
+		return false;
+	
+	hit.t = closest;
+	hit.point = r.pointAt(closest);
+	hit.normal = closestNormal;
+	hit.material = materialObjects_[primitives_[closestIndex].material].get();
+	hit.uv = closestUV;
+	hit.uvScale = primitives_[closestIndex].uvScale();
+	return true;
+}
+
+bool CompiledScene::textured() const {
+	for(const std::unique_ptr<Material>& material: materialObjects_){
+		if( material->textured() )
+			return true;
+	}
+	
+	return false;
+}
+
+bool CompiledScene::diffuseOnly() const {
+	for(const std::unique_ptr<Material>& material: materialObjects_){
+		if( !material->diffuse() )
+			return false;
+	}
+	
+	return true;
+}
+
+AABBf CompiledScene::bounds() const {
+	return bvh_.empty() ? AABBf::empty() : bvh_.nodes()[0].bounds;
+}
+
+// Image texture tiles are left out, the texture cache keeps those within its own budget
+size_t CompiledScene::memoryUsage() const noexcept {
+	return sizeof(CompiledScene) + mappingSize_ +
+		   textureStorage_.capacity() * sizeof(SceneTexture) +
+		   materialStorage_.capacity() * sizeof(SceneMaterial) +
+		   (primitiveStorage_.capacity() + basePrimitives_.capacity()) * sizeof(ScenePrimitive) +
+		   objects_.capacity() * sizeof(SceneObject) +
+		   objectKeys_.capacity() * sizeof(ObjectKeyframe) +
+		   cameraKeys_.capacity() * sizeof(CameraKeyframe) +
+		   bvh_.memoryUsage() +
+		   materialObjects_.size() * sizeof(MetalMaterial);
+}
+
+// MARK: - Animation
+float CompiledScene::startTime() const noexcept {
+	float time = cameraKeys_.empty() ? INFINITY : cameraKeys_.front().time;
+	
+	for(const ObjectKeyframe& key: objectKeys_)
+		time = std::min(time, key.time);
+	
+	return std::isfinite(time) ? time : 0.f;
+}
+
+float CompiledScene::endTime() const noexcept {
+	float time = cameraKeys_.empty() ? -INFINITY : cameraKeys_.back().time;
+	
+	for(const ObjectKeyframe& key: objectKeys_)
+		time = std::max(time, key.time);
+	
+	return std::isfinite(time) ? time : 0.f;
+}
+
+CameraSettings CompiledScene::setTime(float time, RenderPool& pool){
+	CameraSettings camera = camera_;
+	
+	if( !cameraKeys_.empty() ){
+		const CameraKeyframe *before, *after;
+		float t;
+		bracket(cameraKeys_.data(), cameraKeys_.data() + cameraKeys_.size(), time, before, after, t);
+		
+		camera.lookFrom = lerp(t, before->camera.lookFrom, after->camera.lookFrom);
+		camera.lookAt = lerp(t, before->camera.lookAt, after->camera.lookAt);
+		camera.up = lerp(t, before->camera.up, after->camera.up);
+		camera.degVerticalFov = lerp(t, before->camera.degVerticalFov, after->camera.degVerticalFov);
+		camera.aperture = lerp(t, before->camera.aperture, after->camera.aperture);
+		camera.focusDistance = lerp(t, before->camera.focusDistance, after->camera.focusDistance);
+	}
+	
+	if( objectKeys_.empty() )
+		return camera;
+	
+	if( basePrimitives_.empty() ){
+		// Primitives move from now on, so mapped ones need a copy we can write to
+		basePrimitives_.assign(primitives_, primitives_ + primitiveCount_);
+		
+		if( primitives_ != primitiveStorage_.data() ){
+			primitiveStorage_ = basePrimitives_;
+			primitives_ = primitiveStorage_.data();
+		}
+	}
+	
+	// Keys are sorted by object, each run of them animating one object
+	std::vector<size_t> runs;
+	
+	for(size_t i=0; i < objectKeys_.size(); ++i){
+		if( i == 0 || objectKeys_[i].object != objectKeys_[i - 1].object )
+			runs.push_back(i);
+	}
+	
+	runs.push_back(objectKeys_.size());
+	ScenePrimitive *primitives = primitiveStorage_.data();
+	
+	pool.submit(runs.size() - 1, [&](size_t run){
+		const ObjectKeyframe *before, *after;
+		float t;
+		bracket(&objectKeys_[runs[run]], objectKeys_.data() + runs[run + 1], time, before, after, t);
+		
+		const SceneObject& object = objects_[before->object];
+		const Vector3f translation = lerp(t, before->translation, after->translation);
+		const float radians = toRadians(lerp(t, before->degrees, after->degrees));
+		const float c = std::cos(radians), s = std::sin(radians);
+		
+		for(uint32_t i=object.firstPrimitive; i < object.firstPrimitive + object.primitiveCount; ++i){
+			const ScenePrimitive& base = basePrimitives_[i];
+			ScenePrimitive& moved = primitives[i];
+			
+			moved.a = rotateY(base.a - object.anchor, c, s) + object.anchor + translation;
+			moved.e1 = rotateY(base.e1, c, s);
+			moved.e2 = rotateY(base.e2, c, s);
+		}
+	})->wait();
+	
+	bvh_.refit([primitives](uint32_t i){ return primitives[i].bounds(); }, pool);
+	return camera;
+}
@@ -0,0 +1,146 @@
+#ifndef compiled_h
+#define compiled_h
+
+#include "./hittable.hpp"
+#include "./bvh.hpp"
+#include "./scene.hpp"
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <cstdint>
+
+class RenderPool;
+struct Texture;
+
+// MARK: - Flat scene data
+enum class MaterialType: uint32_t { Diffuse, Metal, Dielectric };
+enum class TextureType: uint32_t { Image, Checker };
+
+constexpr uint32_t NO_TEXTURE = ~uint32_t(0);
+
+struct SceneMaterial {
+	MaterialType type;
+	Vector3f albedo;
+	float fuzziness;
+	float refractiveIndex;
+	uint32_t texture; // multiplies the albedo, NO_TEXTURE for none
+};
+
+struct SceneTexture {
+	TextureType type;
+	Vector3f even, odd; // checker colors
+	float frequency;    // checks per unit of texture coordinates
+	char path[1024];    // absolute path of the image
+};
+
+// Spheres and triangles share one record so that primitives can be stored, and mapped, as a single array
+struct ScenePrimitive {
+	Vector3f a;      // sphere center or first triangle vertex
+	Vector3f e1, e2; // triangle edges from the first vertex
+	float radius;    // 0 for triangles
+	uint32_t material;
+	
+	bool isSphere() const noexcept { return radius > 0.f; }
+	AABBf bounds() const noexcept;
+	bool hit(const Rayf& r, float tMin, float tMax, float& t, Vector3f& normal, Vector2f& uv) const noexcept;
+	
+	// Spheres are mapped by longitude and latitude, triangles by their barycentric coordinates
+	float uvScale() const noexcept;
+	
+	static ScenePrimitive sphere(const Vector3f& center, float radius, uint32_t material) noexcept;
+	static ScenePrimitive triangle(const Vector3f& v0, const Vector3f& v1, const Vector3f& v2, uint32_t material) noexcept;
+};
+
+// The primitives of a named sphere or instance, which keyframes move as a whole
+struct SceneObject {
+	uint32_t firstPrimitive, primitiveCount;
+	Vector3f anchor; // rotations are about the vertical axis through it
+};
+
+struct ObjectKeyframe {
+	uint32_t object;
+	float time;
+	Vector3f translation;
+	float degrees;
+};
+
+struct CameraKeyframe {
+	float time;
+	CameraSettings camera;
+};
+
+struct SceneContents {
+	CameraSettings camera;
+	std::vector<SceneTexture> textures;
+	std::vector<SceneMaterial> materials;
+	std::vector<ScenePrimitive> primitives;
+	std::vector<SceneObject> objects;
+	std::vector<ObjectKeyframe> objectKeys;
+	std::vector<CameraKeyframe> cameraKeys;
+};
+
+// MARK: - CompiledScene
+// Flattened primitives, material table and BVH of a scene. The arrays are either owned or used
+// directly from a mapped compiled scene file, in which case loading it does no parsing nor building.
+// The small object and keyframe tables are always copied.
+class CompiledScene: public Hittable {
+public:
+	explicit CompiledScene(SceneContents contents);
+	~CompiledScene();
+	
+	CompiledScene(const CompiledScene&) = delete;
+	CompiledScene& operator=(const CompiledScene&) = delete;
+	
+	// Maps a file written by save, nullptr if it is unreadable, corrupt, or was compiled from another source
+	static std::unique_ptr<CompiledScene> map(const std::string& path, const SourceStamp& source);
+	bool save(const std::string& path, const SourceStamp& source) const;
+	
+	bool hit(const Rayf& r, float tMin, float tMax, Hit& hit) const override;
+	AABBf bounds() const override;
+	bool textured() const override;
+	bool diffuseOnly() const override;
+	
+	const CameraSettings& camera() const noexcept { return camera_; }
+	size_t primitiveCount() const noexcept { return primitiveCount_; }
+	size_t memoryUsage() const noexcept;
+	
+	// MARK: Animation
+	bool animated() const noexcept { return !objectKeys_.empty() || !cameraKeys_.empty(); }
+	float startTime() const noexcept;
+	float endTime() const noexcept;
+	
+	// Moves the keyframed objects where they are at time and refits the BVH on the pool, which must not
+	// run while the scene is being traced. Returns the camera at that time.
+	CameraSettings setTime(float time, RenderPool& pool);
+	
+private:
+	CompiledScene();
+	void createMaterials();
+	void sortKeyframes();
+	
+	CameraSettings camera_;
+	std::vector<SceneObject> objects_;
+	std::vector<ObjectKeyframe> objectKeys_; // by object then time
+	std::vector<CameraKeyframe> cameraKeys_; // by time
+	std::vector<ScenePrimitive> basePrimitives_; // where keyframed primitives are placed before animation
+	
+	std::vector<SceneTexture> textureStorage_;
+	std::vector<SceneMaterial> materialStorage_;
+	std::vector<ScenePrimitive> primitiveStorage_;
+	const SceneTexture *textures_ = nullptr;
+	size_t textureCount_ = 0;
+	const SceneMaterial *materials_ = nullptr;
+	size_t materialCount_ = 0;
+	const ScenePrimitive *primitives_ = nullptr;
+	size_t primitiveCount_ = 0;
+	BVH bvh_;
+	
+	std::vector<std::unique_ptr<Material>> materialObjects_;
+	std::vector<std::shared_ptr<const Texture>> textureObjects_;
+	
+	void *mapping_ = nullptr;
+	size_t mappingSize_ = 0;
+};
+
+#endif /* compiled_h */
@@ -0,0 +1,478 @@
+
+#include "./distributed.hpp"
+#include "./net.hpp"
+#include "./pool.hpp"
+#include "./scene.hpp"
+
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <deque>
+#include <chrono>
+#include <algorithm>
+#include <type_traits>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cassert>
+
+static_assert(std::is_trivially_copyable<HelloInfo>::value && std::is_trivially_copyable<FrameInfo>::value, "sent as raw bytes");
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+	
+	struct Connection {
+		int fd;
+		size_t threads = 0; // known once the worker said hello
+		std::deque<std::vector<Tile>> inFlight;
+		std::vector<char> received; // bytes of the messages that have not fully arrived yet
+		Clock::time_point deadline; // for the hello, then for the next results while tiles are in flight
+		
+		Connection(int f, Clock::time_point d): fd(f), deadline(d) {}
+		
+		bool waiting() const { return threads == 0 || !inFlight.empty(); }
+	};
+	
+	bool sendMessage(int fd, MessageType type, uint32_t count, const void *payload, size_t size){
+		const MessageHeader header = {static_cast<uint32_t>(type), count, size};
+		return sendAll(fd, &header, sizeof(header)) && (size == 0 || sendAll(fd, payload, size));
+	}
+	
+	WireTile toWire(const Tile& tile){
+		return {
+			static_cast<uint32_t>(tile.xStart), static_cast<uint32_t>(tile.yStart),
+			static_cast<uint32_t>(tile.width), static_cast<uint32_t>(tile.height),
+		};
+	}
+	
+	Tile fromWire(const WireTile& tile){
+		return {tile.xStart, tile.yStart, tile.width, tile.height};
+	}
+	
+	bool sameTile(const Tile& a, const Tile& b){
+		return a.xStart == b.xStart && a.yStart == b.yStart && a.width == b.width && a.height == b.height;
+	}
+	
+	bool fitsIn(const WireTile& tile, size_t width, size_t height){
+		return tile.width > 0 && tile.height > 0 &&
+			   size_t(tile.xStart) + tile.width <= width &&
+			   size_t(tile.yStart) + tile.height <= height;
+	}
+	
+	size_t tileBytes(const Tile& tile){
+		return tile.width * tile.height * sizeof(PixelRGBAF);
+	}
+}
+
+// MARK: - Coordinator
+namespace {
+	class Coordinator {
+	public:
+		Coordinator(ImageRGBAF& image, const FrameInfo& frame, const std::vector<Tile>& tiles,
+					const CoordinatorSettings& settings, const std::function<void(const Tile&)>& tileDone)
+		: image_(image), frame_(frame), pending_(tiles.begin(), tiles.end()), remaining_(tiles.size()),
+		  settings_(settings), tileDone_(tileDone) {}
+		
+		bool run(int listenFd, int stopFd){
+			bool stopped = false;
+			
+			while( remaining_ > 0 && !stopped ){
+				std::vector<pollfd> fds;
+				fds.push_back({listenFd, POLLIN, 0});
+				fds.push_back({stopFd, POLLIN, 0});
+				
+				for(const Connection& c: connections_)
+					fds.push_back({c.fd, POLLIN, 0});
+				
+				if( poll(fds.data(), fds.size(), pollTimeout()) < 0 ){
+					if( errno == EINTR )
+						continue;
+					
+					perror("poll");
+					return false;
+				}
+				
+				if( fds[1].revents & POLLIN ){
+					stopped = true;
+					break;
+				}
+				
+				for(size_t i=0; i < connections_.size(); ++i){
+					if( (fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR)) && !receive(connections_[i]) )
+						drop(connections_[i]);
+				}
+				
+				if( fds[0].revents & POLLIN ){
+					const int fd = acceptFrom(listenFd);
+					if( fd >= 0 ){
+						setSendTimeout(fd, settings_.timeoutSeconds);
+						connections_.emplace_back(fd, Clock::now() + timeout());
+					}
+				}
+				
+				// Tiles taken back from the workers that timed out go to the others right away
+				const Clock::time_point now = Clock::now();
+				
+				for(Connection& c: connections_){
+					if( c.fd >= 0 && c.waiting() && now >= c.deadline ){
+						fprintf(stderr, "worker timed out\n");
+						drop(c);
+					}
+				}
+				
+				for(Connection& c: connections_){
+					if( c.fd >= 0 && !feed(c) )
+						drop(c);
+				}
+				
+				connections_.erase(std::remove_if(connections_.begin(), connections_.end(), [](const Connection& c){
+					return c.fd < 0;
+				}), connections_.end());
+			}
+			
+			for(Connection& c: connections_){
+				sendMessage(c.fd, MessageType::Done, 0, nullptr, 0);
+				closeSocket(c.fd);
+			}
+			
+			connections_.clear();
+			return !stopped;
+		}
+		
+	private:
+		Clock::duration timeout() const {
+			return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(settings_.timeoutSeconds));
+		}
+		
+		// Milliseconds until the first worker deadline, -1 when no worker is expected to answer
+		int pollTimeout() const {
+			Clock::duration wait = Clock::duration::max();
+			const Clock::time_point now = Clock::now();
+			
+			for(const Connection& c: connections_){
+				if( c.waiting() )
+					wait = std::min(wait, std::max(c.deadline - now, Clock::duration::zero()));
+			}
+			
+			if( wait == Clock::duration::max() )
+				return -1;
+			
+			// Rounded up so the deadline has passed when poll returns
+			const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(wait + std::chrono::milliseconds(1)).count();
+			return static_cast<int>(std::min<decltype(ms)>(ms, 60000));
+		}
+		
+		// Reads what the worker sent without blocking and handles the messages that are complete
+		bool receive(Connection& c){
+			// Results that arrived just before the worker went away are still merged
+			const bool open = recvAvailable(c.fd, c.received);
+			size_t consumed = 0;
+			bool success = true;
+			
+			while( success ){
+				MessageHeader header;
+				const size_t available = c.received.size() - consumed;
+				
+				if( available < sizeof(header) )
+					break;
+				
+				memcpy(&header, &c.received[consumed], sizeof(header));
+				
+				// Checked as soon as the header is in so a bad size cannot make the buffer grow without bound
+				if( header.size != expectedSize(c, header) )
+					return false;
+				
+				if( available - sizeof(header) < header.size )
+					break;
+				
+				success = handle(c, header, &c.received[consumed + sizeof(header)]);
+				consumed += sizeof(header) + header.size;
+			}
+			
+			c.received.erase(c.received.begin(), c.received.begin() + consumed);
+			return success && open;
+		}
+		
+		// The payload size the message must have, ~0 when the worker is not allowed to send it
+		uint64_t expectedSize(const Connection& c, const MessageHeader& header) const {
+			switch(static_cast<MessageType>(header.type)){
+				case MessageType::Hello:
+					return c.threads == 0 ? sizeof(HelloInfo) : ~uint64_t(0);
+					
+				case MessageType::Results: {
+					// Workers return batches whole and in the order they were sent
+					if( c.inFlight.empty() || header.count != c.inFlight.front().size() )
+						return ~uint64_t(0);
+					
+					uint64_t size = 0;
+					for(const Tile& tile: c.inFlight.front())
+						size += sizeof(WireTile) + tileBytes(tile);
+					
+					return size;
+				}
+					
+				default:
+					fprintf(stderr, "unexpected message %u from worker\n", header.type);
+					return ~uint64_t(0);
+			}
+		}
+		
+		bool handle(Connection& c, const MessageHeader& header, const char *payload){
+			if( static_cast<MessageType>(header.type) == MessageType::Hello ){
+				HelloInfo hello;
+				memcpy(&hello, payload, sizeof(hello));
+				
+				// The frame still goes out so the worker can tell why it is turned away
+				if( hello.scene != frame_.scene ){
+					fprintf(stderr, "worker loaded another scene, turning it away\n");
+					sendMessage(c.fd, MessageType::Frame, 0, &frame_, sizeof(frame_));
+					return false;
+				}
+				
+				c.threads = std::max<size_t>(hello.threads, 1);
+				return sendMessage(c.fd, MessageType::Frame, 0, &frame_, sizeof(frame_));
+			}
+			
+			const std::vector<Tile>& batch = c.inFlight.front();
+			
+			for(const Tile& tile: batch){
+				WireTile wire;
+				memcpy(&wire, payload, sizeof(wire));
+				payload += sizeof(wire);
+				
+				if( !sameTile(fromWire(wire), tile) )
+					return false;
+				
+				for(size_t y=0; y < tile.height; ++y){
+					memcpy(&image_.pixels()[(tile.yStart + y) * image_.width() + tile.xStart], payload, tile.width * sizeof(PixelRGBAF));
+					payload += tile.width * sizeof(PixelRGBAF);
+				}
+			}
+			
+			for(const Tile& tile: batch)
+				tileDone_(tile);
+			
+			remaining_ -= batch.size();
+			c.inFlight.pop_front();
+			c.deadline = Clock::now() + timeout();
+			return true;
+		}
+		
+		bool feed(Connection& c){
+			if( c.threads == 0 )
+				return true;
+			
+			const size_t batchSize = settings_.batchSize > 0 ? settings_.batchSize : c.threads;
+			
+			while( c.inFlight.size() < settings_.batchesInFlight && !pending_.empty() ){
+				std::vector<WireTile> wire;
+				
+				// The worker has until the deadline to return the first of its batches
+				if( c.inFlight.empty() )
+					c.deadline = Clock::now() + timeout();
+				
+				c.inFlight.emplace_back();
+				
+				while( c.inFlight.back().size() < batchSize && !pending_.empty() ){
+					c.inFlight.back().push_back(pending_.front());
+					wire.push_back(toWire(pending_.front()));
+					pending_.pop_front();
+				}
+				
+				if( !sendMessage(c.fd, MessageType::Tiles, static_cast<uint32_t>(wire.size()), wire.data(), wire.size() * sizeof(WireTile)) )
+					return false;
+			}
+			
+			return true;
+		}
+		
+		void drop(Connection& c){
+			size_t lost = 0;
+			
+			for(auto batch=c.inFlight.rbegin(); batch != c.inFlight.rend(); ++batch){
+				pending_.insert(pending_.begin(), batch->begin(), batch->end());
+				lost += batch->size();
+			}
+			
+			if( lost > 0 )
+				fprintf(stderr, "worker lost, reassigning %zu tiles\n", lost);
+			
+			c.inFlight.clear();
+			closeSocket(c.fd);
+			c.fd = -1;
+		}
+		
+		ImageRGBAF& image_;
+		const FrameInfo& frame_;
+		std::deque<Tile> pending_;
+		size_t remaining_;
+		const CoordinatorSettings& settings_;
+		const std::function<void(const Tile&)>& tileDone_;
+		std::vector<Connection> connections_;
+	};
+}
+
+CoordinatorStop::CoordinatorStop(){
+	if( pipe(pipe_) != 0 ){
+		perror("pipe");
+		pipe_[0] = pipe_[1] = -1;
+		return;
+	}
+	
+	// Signalling again once the pipe is full must not block
+	fcntl(pipe_[1], F_SETFL, O_NONBLOCK);
+}
+
+CoordinatorStop::~CoordinatorStop(){
+	if( pipe_[0] >= 0 ){
+		close(pipe_[0]);
+		close(pipe_[1]);
+	}
+}
+
+void CoordinatorStop::signal(){
+	const char byte = 1;
+	
+	// Only the first byte matters, the pipe is never drained
+	if( pipe_[1] >= 0 && write(pipe_[1], &byte, 1) < 0 && errno != EAGAIN )
+		perror("write");
+}
+
+bool runCoordinator(const std::string& address, ImageRGBAF& image, uint64_t scene, const Camera& camera, size_t sampleCount,
+					const std::vector<Tile>& tiles, const CoordinatorSettings& settings,
+					const std::function<void(const Tile&)>& tileDone, CoordinatorStop *stop){
+	assert(settings.batchesInFlight > 0);
+	assert(settings.timeoutSeconds > 0);
+	
+	for(const Tile& tile: tiles){
+		if( !fitsIn(toWire(tile), image.width(), image.height()) ){
+			fprintf(stderr, "tile out of the image bounds\n");
+			return false;
+		}
+	}
+	
+	const int listenFd = listenOn(address);
+	if( listenFd < 0 )
+		return false;
+	
+	FrameInfo frame;
+	frame.width = static_cast<uint32_t>(image.width());
+	frame.height = static_cast<uint32_t>(image.height());
+	frame.sampleCount = static_cast<uint32_t>(sampleCount);
+	frame.scene = scene;
+	frame.camera = camera;
+	
+	Coordinator coordinator(image, frame, tiles, settings, tileDone);
+	const bool success = coordinator.run(listenFd, stop != nullptr ? stop->fd() : -1);
+	closeSocket(listenFd);
+	return success;
+}
+
+// MARK: - Worker
+namespace {
+	bool sendResults(int fd, const ImageRGBAF& image, const std::vector<Tile>& batch, std::vector<char>& buffer){
+		buffer.clear();
+		
+		for(const Tile& tile: batch){
+			const WireTile wire = toWire(tile);
+			buffer.insert(buffer.end(), reinterpret_cast<const char*>(&wire), reinterpret_cast<const char*>(&wire + 1));
+			
+			for(size_t y=tile.yStart; y < tile.yStart + tile.height; ++y){
+				const PixelRGBAF *row = &image.pixels()[y * image.width() + tile.xStart];
+				buffer.insert(buffer.end(), reinterpret_cast<const char*>(row), reinterpret_cast<const char*>(row + tile.width));
+			}
+		}
+		
+		return sendMessage(fd, MessageType::Results, static_cast<uint32_t>(batch.size()), buffer.data(), buffer.size());
+	}
+}
+
+bool runWorker(const std::string& address, const Scene& scene, size_t numThreads){
+	assert(numThreads > 0);
+	
+	const int fd = connectTo(address);
+	if( fd < 0 )
+		return false;
+	
+	HelloInfo hello = {};
+	hello.threads = static_cast<uint32_t>(numThreads);
+	hello.scene = scene.fingerprint;
+	bool success = sendMessage(fd, MessageType::Hello, 0, &hello, sizeof(hello));
+	
+	FrameInfo frame;
+	TileKernel kernel = nullptr;
+	ImageRGBAF image;
+	std::vector<WireTile> wire;
+	std::vector<Tile> batch;
+	std::vector<char> buffer;
+	RenderPool pool(numThreads);
+	
+	for(bool running=success; running;){
+		MessageHeader header;
+		
+		if( !recvAll(fd, &header, sizeof(header)) ){
+			fprintf(stderr, "lost the connection to the coordinator\n");
+			success = false;
+			break;
+		}
+		
+		switch(static_cast<MessageType>(header.type)){
+			case MessageType::Frame:
+				success = header.size == sizeof(frame) && recvAll(fd, &frame, sizeof(frame)) &&
+						  frame.width > 0 && frame.height > 0 && frame.sampleCount > 0;
+				
+				if( success && frame.scene != scene.fingerprint ){
+					fprintf(stderr, "the coordinator renders another scene\n");
+					success = false;
+				}
+				
+				if( success ){
+					image.assign(frame.width, frame.height);
+					kernel = selectKernel(kernelConfigFor(*scene.world, frame.camera, frame.sampleCount, MAX_DEPTH));
+				}
+				break;
+				
+			case MessageType::Tiles:
+				// Checked before anything is allocated, a batch can't hold more tiles than the frame has pixels
+				if( !image || header.size != uint64_t(header.count) * sizeof(WireTile) ||
+				    header.count > image.width() * image.height() ){
+					fprintf(stderr, "malformed tile batch from coordinator\n");
+					success = false;
+					break;
+				}
+				
+				wire.resize(header.count);
+				batch.clear();
+				success = recvAll(fd, wire.data(), header.size);
+
+				for(size_t i=0; success && i < wire.size(); ++i){
+					success = fitsIn(wire[i], image.width(), image.height());
+					batch.push_back(fromWire(wire[i]));
+				}
+				
+				if( success ){
+					pool.submit(batch, [&](const Tile& tile){
+						kernel(image, *scene.world, frame.camera, tile, frame.sampleCount, MAX_DEPTH);
+					})->wait();
+					
+					success = sendResults(fd, image, batch, buffer);
+				}
+				break;
+				
+			case MessageType::Done:
+				running = false;
+				break;
+				
+			default:
+				fprintf(stderr, "unexpected message %u from coordinator\n", header.type);
+				success = false;
+				break;
+		}
+		
+		running = running && success;
+	}
+	
+	closeSocket(fd);
+	return success;
+}
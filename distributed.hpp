@@ -0,0 +1,88 @@
+#ifndef distributed_h
+#define distributed_h
+
+#include "./image.hpp"
+#include "./render.hpp"
+#include "./camera.hpp"
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+struct Scene;
+
+// MARK: - Protocol
+// Every message is a header followed by `size` bytes of payload. Values are sent in host byte order,
+// so the coordinator and its workers must run on machines of the same endianness.
+enum class MessageType: uint32_t {
+	Hello,   // worker -> coordinator: HelloInfo
+	Frame,   // coordinator -> worker: FrameInfo, the last message to a worker that loaded another scene
+	Tiles,   // coordinator -> worker: `count` WireTiles to render
+	Results, // worker -> coordinator: `count` WireTiles, each followed by its RGBAF pixels row by row
+	Done,    // coordinator -> worker: no more work, disconnect
+};
+
+struct MessageHeader {
+	uint32_t type;
+	uint32_t count;
+	uint64_t size;
+};
+
+struct WireTile {
+	uint32_t xStart, yStart;
+	uint32_t width, height;
+};
+
+struct HelloInfo {
+	uint32_t threads;
+	uint64_t scene; // Scene::fingerprint
+};
+
+struct FrameInfo {
+	uint32_t width, height;
+	uint32_t sampleCount;
+	uint64_t scene;
+	Camera camera;
+};
+
+// MARK: - Coordinator
+struct CoordinatorSettings {
+	size_t batchSize = 0;       // tiles per message, 0 uses the worker's thread count
+	size_t batchesInFlight = 2; // batches queued on each worker to hide the round trips
+	double timeoutSeconds = 60; // how long a worker may hold tiles without returning any
+};
+
+// Lets another thread end a coordinator early, e.g. when the window showing its frame is closed
+class CoordinatorStop {
+public:
+	CoordinatorStop();
+	~CoordinatorStop();
+	
+	CoordinatorStop(const CoordinatorStop&) = delete;
+	CoordinatorStop& operator=(const CoordinatorStop&) = delete;
+	
+	void signal();
+	
+	// Becomes readable once signalled, so it can be polled next to the sockets
+	int fd() const noexcept { return pipe_[0]; }
+	
+private:
+	int pipe_[2];
+};
+
+// Hands out the tiles to the workers connecting on address until all of them are rendered into image.
+// Workers that loaded another scene than the one with fingerprint scene are turned away.
+// Tiles held by a worker that disconnects or times out before returning them are handed out again.
+// tileDone is called on the calling thread as each tile lands in image. Returns false without
+// finishing the frame when stop is signalled.
+bool runCoordinator(const std::string& address, ImageRGBAF& image, uint64_t scene, const Camera& camera, size_t sampleCount,
+					const std::vector<Tile>& tiles, const CoordinatorSettings& settings,
+					const std::function<void(const Tile&)>& tileDone, CoordinatorStop *stop = nullptr);
+
+// MARK: - Worker
+// Renders the tiles of scene handed out by the coordinator at address on numThreads threads until it is done.
+// Fails when the coordinator renders another scene.
+bool runWorker(const std::string& address, const Scene& scene, size_t numThreads);
+
+#endif /* distributed_h */
@@ -12,6 +12,14 @@ Hittable::~Hittable(){
 	delete material;
 }
 
+bool Hittable::textured() const {
+	return material != nullptr && material->textured();
+}
+
+bool Hittable::diffuseOnly() const {
+	return material != nullptr && material->diffuse();
+}
+
 // MARK: - Sphere
 bool Sphere::hit(const Rayf& r, float tMin, float tMax, Hit& hit) const {
 	const Vector3f oc = r.origin - center;
@@ -28,6 +36,8 @@ bool Sphere::hit(const Rayf& r, float tMin, float tMax, Hit& hit) const {
 			hit.point = r.pointAt(t1);
 			hit.normal = (hit.point - center) / radius;
 			hit.material = material;
+			hit.uv = sphereUV(hit.normal);
+			hit.uvScale = float(M_PI) * radius;
 			return true;
 		}
 		
@@ -38,9 +48,16 @@ bool Sphere::hit(const Rayf& r, float tMin, float tMax, Hit& hit) const {
 			hit.point = r.pointAt(t2);
 			hit.normal = (hit.point - center) / radius;
 			hit.material = material;
+			hit.uv = sphereUV(hit.normal);
+			hit.uvScale = float(M_PI) * radius;
 			return true;
 		}
 	}
 	
 	return false;
 }
+
+AABBf Sphere::bounds() const {
+	const Vector3f extent = {radius, radius, radius};
+	return {center - extent, center + extent};
+}
@@ -10,11 +10,34 @@ struct Hit {
 	Vector3f point;
 	Vector3f normal;
 	Material *material = nullptr;
+	
+	// Texture coordinates, and roughly how far one unit of them spans on the surface
+	Vector2f uv;
+	float uvScale = 1.f;
+	
+	// Width of the pixel's footprint in texture coordinates, set by the integrator
+	float footprint = 0.f;
 };
 
+// Longitude and latitude of the point of a sphere with the given normal, with uvScale = pi * radius
+inline Vector2f sphereUV(const Vector3f& normal){
+	return {
+		.5f + std::atan2(-normal.z, normal.x) / float(2 * M_PI),
+		.5f + std::asin(clamp(normal.y, -1.f, 1.f)) / float(M_PI),
+	};
+}
+
 struct Hittable {
 	virtual ~Hittable();
 	virtual bool hit(const Rayf&, float tMin, float tMax, Hit&) const = 0;
+	virtual AABBf bounds() const = 0;
+	
+	// Whether any material hit may sample a texture, which picks the kernel rendering it
+	virtual bool textured() const;
+	
+	// Whether every material hit is diffuse, which also picks the kernel
+	virtual bool diffuseOnly() const;
+	
 	Material *material;
 	
 protected:
@@ -29,6 +52,7 @@ struct Sphere: public Hittable {
 	: Hittable(m), center(c), radius(r) {}
 	
 	bool hit(const Rayf& r, float tMin, float tMax, Hit& hit) const override;
+	AABBf bounds() const override;
 };
 
 #endif /* hittable_h */
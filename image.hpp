@@ -4,6 +4,11 @@
 #include "./math.hpp"
 
 #include <cassert>
+#include <cstdio>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <cstring>
 
 template<class Pixel> struct Image {
 	Image(){}
@@ -29,6 +34,7 @@ template<class Pixel> struct Image {
 		o.pixels_ = nullptr;
 		o.width_ = 0;
 		o.height_ = 0;
+		return *this;
 	}
 	
 	Image(size_t w, size_t h){
@@ -76,4 +82,142 @@ template<class T> using ImageRGBA = Image<PixelRGBA<T>>;
 using ImageRGBAUNorm = Image<PixelRGBAUNorm>;
 using ImageRGBAF = Image<PixelRGBAF>;
 
+// Encodes the image as a binary PPM. Rows are stored bottom up in memory, as they are displayed flipped.
+inline void encodePPM(const ImageRGBAUNorm& img, std::vector<uint8_t>& out){
+	char header[64];
+	const int headerSize = snprintf(header, sizeof(header), "P6\n%zu %zu\n255\n", img.width(), img.height());
+	
+	out.clear();
+	out.reserve(size_t(headerSize) + 3 * img.width() * img.height());
+	out.insert(out.end(), header, header + headerSize);
+	
+	for(size_t y=img.height(); y-- > 0;){
+		for(size_t x=0; x < img.width(); ++x){
+			const PixelRGBAUNorm& pixel = img.pixels()[y * img.width() + x];
+			out.push_back(pixel.r);
+			out.push_back(pixel.g);
+			out.push_back(pixel.b);
+		}
+	}
+}
+
+inline bool writeFile(const char *path, const std::vector<uint8_t>& data){
+	FILE *file = fopen(path, "wb");
+	if( file == nullptr )
+		return false;
+	
+	const bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+	return fclose(file) == 0 && written;
+}
+
+inline bool writePPM(const ImageRGBAUNorm& img, const char *path){
+	std::vector<uint8_t> data;
+	encodePPM(img, data);
+	return writeFile(path, data);
+}
+
+// Reads the header of a binary PPM, leaving file at its first row of pixels, stored top down
+inline bool readPPMHeader(FILE *file, size_t& width, size_t& height){
+	char magic[3] = {};
+	size_t maxValue = 0;
+	
+	// Comments in the header are not supported
+	return fscanf(file, "%2s %zu %zu %zu", magic, &width, &height, &maxValue) == 4 &&
+		   fgetc(file) != EOF && strcmp(magic, "P6") == 0 &&
+		   width > 0 && height > 0 && maxValue == 255;
+}
+
+// Reads an 8 bit binary PPM written by writePPM or any other program, flipping it bottom up in memory
+inline bool readPPM(ImageRGBAUNorm& img, const char *path){
+	FILE *file = fopen(path, "rb");
+	if( file == nullptr )
+		return false;
+	
+	size_t width = 0, height = 0;
+	
+	if( !readPPMHeader(file, width, height) ){
+		fclose(file);
+		return false;
+	}
+	
+	img.assign(width, height);
+	std::vector<uint8_t> row(3 * width);
+	bool read = true;
+	
+	for(size_t y=height; y-- > 0 && read;){
+		read = fread(row.data(), 1, row.size(), file) == row.size();
+		
+		for(size_t x=0; x < width; ++x)
+			img.pixels()[y * width + x] = {row[3 * x + 0], row[3 * x + 1], row[3 * x + 2], 255};
+	}
+	
+	fclose(file);
+	return read;
+}
+
+// Writes the image as a little endian PFM, which stores its rows bottom up as we do
+inline bool writePFM(const ImageRGBAF& img, const char *path){
+	FILE *file = fopen(path, "wb");
+	if( file == nullptr )
+		return false;
+	
+	fprintf(file, "PF\n%zu %zu\n-1.0\n", img.width(), img.height());
+	
+	std::vector<float> row(3 * img.width());
+	bool written = true;
+	
+	for(size_t y=0; y < img.height() && written; ++y){
+		for(size_t x=0; x < img.width(); ++x){
+			const PixelRGBAF& pixel = img.pixels()[y * img.width() + x];
+			row[3 * x + 0] = pixel.r;
+			row[3 * x + 1] = pixel.g;
+			row[3 * x + 2] = pixel.b;
+		}
+		
+		written = fwrite(row.data(), sizeof(float), row.size(), file) == row.size();
+	}
+	
+	return fclose(file) == 0 && written;
+}
+
+// Reads a color PFM written by a little endian machine
+inline bool readPFM(ImageRGBAF& img, const char *path){
+	const uint32_t one = 1;
+	uint8_t firstByte;
+	memcpy(&firstByte, &one, 1);
+	
+	FILE *file = fopen(path, "rb");
+	if( file == nullptr )
+		return false;
+	
+	char magic[3] = {};
+	size_t width = 0, height = 0;
+	float scale = 0;
+	
+	const bool valid = fscanf(file, "%2s %zu %zu %f", magic, &width, &height, &scale) == 4 &&
+					   fgetc(file) != EOF && strcmp(magic, "PF") == 0 &&
+					   width > 0 && height > 0 && scale < 0 && firstByte == 1;
+	
+	if( !valid ){
+		fclose(file);
+		return false;
+	}
+	
+	img.assign(width, height);
+	std::vector<float> row(3 * width);
+	bool read = true;
+	
+	for(size_t y=0; y < height && read; ++y){
+		read = fread(row.data(), sizeof(float), row.size(), file) == row.size();
+		
+		for(size_t x=0; x < width; ++x){
+			PixelRGBAF& pixel = img.pixels()[y * width + x];
+			pixel = {row[3 * x + 0], row[3 * x + 1], row[3 * x + 2], 1.f};
+		}
+	}
+	
+	fclose(file);
+	return read;
+}
+
 #endif /* image_h */
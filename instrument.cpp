@@ -0,0 +1,237 @@
+
+#include "./instrument.hpp"
+#include "./render.hpp"
+
+RenderCounters& RenderCounters::operator+=(const RenderCounters& o){
+	cameraRays += o.cameraRays;
+	diffuseRays += o.diffuseRays;
+	reflectedRays += o.reflectedRays;
+	refractedRays += o.refractedRays;
+	boxTests += o.boxTests;
+	primitiveTests += o.primitiveTests;
+	bounces += o.bounces;
+	escapedPaths += o.escapedPaths;
+	absorbedPaths += o.absorbedPaths;
+	depthLimitedPaths += o.depthLimitedPaths;
+	diffuseScatters += o.diffuseScatters;
+	metalScatters += o.metalScatters;
+	dielectricScatters += o.dielectricScatters;
+	return *this;
+}
+
+RenderCounters RenderCounters::operator-(const RenderCounters& o) const {
+	RenderCounters result = *this;
+	result.cameraRays -= o.cameraRays;
+	result.diffuseRays -= o.diffuseRays;
+	result.reflectedRays -= o.reflectedRays;
+	result.refractedRays -= o.refractedRays;
+	result.boxTests -= o.boxTests;
+	result.primitiveTests -= o.primitiveTests;
+	result.bounces -= o.bounces;
+	result.escapedPaths -= o.escapedPaths;
+	result.absorbedPaths -= o.absorbedPaths;
+	result.depthLimitedPaths -= o.depthLimitedPaths;
+	result.diffuseScatters -= o.diffuseScatters;
+	result.metalScatters -= o.metalScatters;
+	result.dielectricScatters -= o.dielectricScatters;
+	return result;
+}
+
+#if RT_INSTRUMENT
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <algorithm>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+	
+	struct TileEvent {
+		Tile tile;
+		Clock::time_point start, end;
+		RenderCounters counters;
+	};
+	
+	// Owned by the registry rather than the thread, so records outlive the pool threads that wrote them
+	struct ThreadRecord {
+		size_t id;
+		std::string name;
+		RenderCounters counters;
+		std::vector<TileEvent> tiles;
+	};
+	
+	const Clock::time_point epoch = Clock::now();
+	
+	std::mutex registryLock;
+	std::vector<std::unique_ptr<ThreadRecord>> registry;
+	thread_local ThreadRecord *currentThreadRecord = nullptr;
+	
+	// Time spent per pixel summed over every pass, grown to cover the tiles as they come in
+	std::mutex heatMapLock;
+	size_t heatMapWidth = 0, heatMapHeight = 0;
+	std::vector<float> heatMap;
+	
+	void addToHeatMap(const Tile& tile, const std::vector<float>& pixelCosts){
+		std::lock_guard<std::mutex> lg(heatMapLock);
+		const size_t width = std::max(heatMapWidth, tile.xStart + tile.width);
+		const size_t height = std::max(heatMapHeight, tile.yStart + tile.height);
+		
+		if( width != heatMapWidth || height != heatMapHeight ){
+			std::vector<float> grown(width * height, 0.f);
+			
+			for(size_t y=0; y < heatMapHeight; ++y)
+				std::copy_n(heatMap.begin() + y * heatMapWidth, heatMapWidth, grown.begin() + y * width);
+			
+			heatMap.swap(grown);
+			heatMapWidth = width;
+			heatMapHeight = height;
+		}
+		
+		for(size_t i=0; i < pixelCosts.size(); ++i)
+			heatMap[(tile.yStart + i / tile.width) * width + tile.xStart + i % tile.width] += pixelCosts[i];
+	}
+	
+	ThreadRecord& threadRecord(){
+		if( currentThreadRecord == nullptr )
+			registerThread();
+		
+		return *currentThreadRecord;
+	}
+	
+	double microseconds(Clock::time_point time){
+		return std::chrono::duration<double, std::micro>(time - epoch).count();
+	}
+	
+	void writeCountersJSON(FILE *file, const RenderCounters& c){
+		fprintf(file, "{\"cameraRays\": %llu, \"diffuseRays\": %llu, \"reflectedRays\": %llu, \"refractedRays\": %llu, "
+				"\"boxTests\": %llu, \"primitiveTests\": %llu, \"bounces\": %llu, "
+				"\"escapedPaths\": %llu, \"absorbedPaths\": %llu, \"depthLimitedPaths\": %llu, "
+				"\"diffuseScatters\": %llu, \"metalScatters\": %llu, \"dielectricScatters\": %llu}",
+				(unsigned long long)c.cameraRays, (unsigned long long)c.diffuseRays,
+				(unsigned long long)c.reflectedRays, (unsigned long long)c.refractedRays,
+				(unsigned long long)c.boxTests, (unsigned long long)c.primitiveTests, (unsigned long long)c.bounces,
+				(unsigned long long)c.escapedPaths, (unsigned long long)c.absorbedPaths,
+				(unsigned long long)c.depthLimitedPaths, (unsigned long long)c.diffuseScatters,
+				(unsigned long long)c.metalScatters, (unsigned long long)c.dielectricScatters);
+	}
+	
+	// Black through red and yellow to white
+	PixelRGBAUNorm heat(float value){
+		const float scaled = clamp(value, 0.f, 1.f) * 3.f;
+		
+		return {
+			static_cast<uint8_t>(clamp(scaled, 0.f, 1.f) * 255),
+			static_cast<uint8_t>(clamp(scaled - 1.f, 0.f, 1.f) * 255),
+			static_cast<uint8_t>(clamp(scaled - 2.f, 0.f, 1.f) * 255),
+			255,
+		};
+	}
+}
+
+thread_local RenderCounters *currentThreadCounters = nullptr;
+
+RenderCounters& registerThread(){
+	std::lock_guard<std::mutex> lg(registryLock);
+	
+	registry.emplace_back(new ThreadRecord());
+	ThreadRecord *record = registry.back().get();
+	record->id = registry.size();
+	record->name = "thread " + std::to_string(record->id);
+	
+	currentThreadRecord = record;
+	currentThreadCounters = &record->counters;
+	return record->counters;
+}
+
+void nameThread(const char *format, size_t index){
+	char name[64];
+	snprintf(name, sizeof(name), format, index);
+	threadRecord().name = name;
+}
+
+// MARK: - TileProfile
+TileProfile::TileProfile(const Tile& tile): tile_(tile), start_(Clock::now()), last_(start_), counters_(threadCounters()) {
+	pixelCosts_.reserve(tile.width * tile.height);
+}
+
+TileProfile::~TileProfile(){
+	ThreadRecord& record = threadRecord();
+	record.tiles.push_back({tile_, start_, Clock::now(), record.counters - counters_});
+	addToHeatMap(tile_, pixelCosts_);
+}
+
+// MARK: - Reports
+RenderCounters totalCounters(){
+	std::lock_guard<std::mutex> lg(registryLock);
+	RenderCounters total;
+	
+	for(const auto& record: registry)
+		total += record->counters;
+	
+	return total;
+}
+
+void printCounters(FILE *file, const RenderCounters& c){
+	fprintf(file,
+			"rays: %llu camera, %llu diffuse, %llu reflected, %llu refracted\n"
+			"tests: %llu box, %llu primitive\n"
+			"paths: %llu bounces, %llu escaped, %llu absorbed, %llu depth limited\n"
+			"scatters: %llu diffuse, %llu metal, %llu dielectric\n",
+			(unsigned long long)c.cameraRays, (unsigned long long)c.diffuseRays,
+			(unsigned long long)c.reflectedRays, (unsigned long long)c.refractedRays,
+			(unsigned long long)c.boxTests, (unsigned long long)c.primitiveTests,
+			(unsigned long long)c.bounces, (unsigned long long)c.escapedPaths,
+			(unsigned long long)c.absorbedPaths, (unsigned long long)c.depthLimitedPaths,
+			(unsigned long long)c.diffuseScatters, (unsigned long long)c.metalScatters,
+			(unsigned long long)c.dielectricScatters);
+}
+
+bool writeChromeTrace(const char *path){
+	FILE *file = fopen(path, "w");
+	if( file == nullptr )
+		return false;
+	
+	std::lock_guard<std::mutex> lg(registryLock);
+	const char *separator = "";
+	
+	fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	
+	for(const auto& record: registry){
+		fprintf(file, "%s\t{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %zu, \"args\": {\"name\": \"%s\"}}",
+				separator, record->id, record->name.c_str());
+		separator = ",\n";
+		
+		for(const TileEvent& event: record->tiles){
+			fprintf(file, ",\n\t{\"name\": \"tile %zu,%zu\", \"cat\": \"tile\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+					"\"pid\": 1, \"tid\": %zu, \"args\": {\"x\": %zu, \"y\": %zu, \"width\": %zu, \"height\": %zu, \"counters\": ",
+					event.tile.xStart, event.tile.yStart, microseconds(event.start), microseconds(event.end) - microseconds(event.start),
+					record->id, event.tile.xStart, event.tile.yStart, event.tile.width, event.tile.height);
+			writeCountersJSON(file, event.counters);
+			fprintf(file, "}}");
+		}
+	}
+	
+	fprintf(file, "\n]}\n");
+	return fclose(file) == 0;
+}
+
+bool writeHeatMap(const char *path){
+	std::lock_guard<std::mutex> lg(heatMapLock);
+	
+	if( heatMap.empty() )
+		return false;
+	
+	// Scaled to the 99th percentile, the odd pixel that was preempted would otherwise leave the rest black
+	std::vector<float> sorted = heatMap;
+	std::nth_element(sorted.begin(), sorted.begin() + sorted.size() * 99 / 100, sorted.end());
+	const float scale = sorted[sorted.size() * 99 / 100];
+	ImageRGBAUNorm image(heatMapWidth, heatMapHeight);
+	
+	for(size_t i=0; i < heatMap.size(); ++i)
+		image.pixels()[i] = heat(scale > 0.f ? heatMap[i] / scale : 0.f);
+	
+	return writePPM(image, path);
+}
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef instrument_h
+#define instrument_h
+
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <vector>
+
+// Render instrumentation, compiled out unless built with RT_INSTRUMENT=1. When enabled every thread keeps its own
+// counters and tile timings, so the hot paths only ever touch thread local memory.
+#ifndef RT_INSTRUMENT
+#define RT_INSTRUMENT 0
+#endif
+
+struct Tile;
+
+struct RenderCounters {
+	// Rays by type
+	uint64_t cameraRays = 0;
+	uint64_t diffuseRays = 0;
+	uint64_t reflectedRays = 0;
+	uint64_t refractedRays = 0;
+	
+	uint64_t boxTests = 0;
+	uint64_t primitiveTests = 0;
+	uint64_t bounces = 0;
+	
+	// Why paths ended, there is no Russian roulette so paths only end by leaving the scene, being absorbed or
+	// reaching the depth limit
+	uint64_t escapedPaths = 0;
+	uint64_t absorbedPaths = 0;
+	uint64_t depthLimitedPaths = 0;
+	
+	// Scatter calls per material type
+	uint64_t diffuseScatters = 0;
+	uint64_t metalScatters = 0;
+	uint64_t dielectricScatters = 0;
+	
+	RenderCounters& operator+=(const RenderCounters& o);
+	RenderCounters operator-(const RenderCounters& o) const;
+};
+
+#if RT_INSTRUMENT
+
+#define RT_COUNT(counter) (++threadCounters().counter)
+#define RT_ADD(counter, amount) (threadCounters().counter += (amount))
+
+extern thread_local RenderCounters *currentThreadCounters;
+RenderCounters& registerThread();
+
+inline RenderCounters& threadCounters(){
+	return currentThreadCounters != nullptr ? *currentThreadCounters : registerThread();
+}
+
+// Names the calling thread in the trace
+void nameThread(const char *format, size_t index);
+
+// Records the time spent on a tile and on each of its pixels, which have to be finished in row major order
+class TileProfile {
+public:
+	explicit TileProfile(const Tile& tile);
+	~TileProfile();
+	
+	TileProfile(const TileProfile&) = delete;
+	TileProfile& operator=(const TileProfile&) = delete;
+	
+	void pixelDone(){
+		const Clock::time_point now = Clock::now();
+		pixelCosts_.push_back(std::chrono::duration<float, std::nano>(now - last_).count());
+		last_ = now;
+	}
+	
+private:
+	using Clock = std::chrono::steady_clock;
+	
+	const Tile& tile_;
+	Clock::time_point start_, last_;
+	RenderCounters counters_;
+	std::vector<float> pixelCosts_;
+};
+
+// Totals over all threads. Like the exports below it must not be called while rendering.
+RenderCounters totalCounters();
+void printCounters(FILE *file, const RenderCounters& counters);
+
+// Writes every recorded tile as an event in Chrome's trace event format, one row per thread
+bool writeChromeTrace(const char *path);
+
+// Writes the time spent per pixel, summed over all recorded tiles, as a PPM going from black to white
+bool writeHeatMap(const char *path);
+
+#else
+
+#define RT_COUNT(counter) ((void)0)
+#define RT_ADD(counter, amount) ((void)0)
+
+inline void nameThread(const char * /*format*/, size_t /*index*/){}
+
+class TileProfile {
+public:
+	explicit TileProfile(const Tile& /*tile*/){}
+	void pixelDone(){}
+};
+
+#endif
+
+#endif /* instrument_h */
@@ -1,15 +1,25 @@
 
 #include "./math.hpp"
 #include "./image.hpp"
-#include "./world.hpp"
 #include "./camera.hpp"
-#include "./material.hpp"
+#include "./render.hpp"
+#include "./scene.hpp"
+#include "./distributed.hpp"
+#include "./pool.hpp"
+#include "./cache.hpp"
+#include "./server.hpp"
+#include "./compiled.hpp"
+#include "./sequence.hpp"
+#include "./benchmark.hpp"
+#include "./instrument.hpp"
+#include "./texture.hpp"
 
 #include <SDL2/SDL.h>
 
 #include <thread>
-#include <limits>
-#include <queue>
+#include <memory>
+#include <string>
+#include <cstring>
 
 static constexpr size_t IMAGE_WIDTH = 1280;
 static constexpr size_t IMAGE_HEIGHT = 720;
@@ -19,109 +29,133 @@ static constexpr float ASPECT_RATIO = float(IMAGE_WIDTH) / float(IMAGE_HEIGHT);
 static constexpr size_t NUM_TILE_X = 8;
 static constexpr size_t NUM_TILE_Y = 10;
 static constexpr size_t NUM_WORKERS = 8;
+static constexpr size_t SCENE_CACHE_MB = 512;
+static constexpr size_t TEXTURE_CACHE_MB = 256;
+static constexpr size_t REFERENCE_SAMPLE_COUNT = 4096;
 
-static_assert(IMAGE_WIDTH % NUM_TILE_X == 0, "all tiles must have equal dimensions");
-static_assert(IMAGE_HEIGHT % NUM_TILE_Y == 0, "all tiles must have equal dimensions");
+// generateTiles spreads uneven sizes over the tiles, it only needs a pixel for every one of them
+static_assert(RES_DIVIDER > 0 && NUM_TILE_X > 0 && NUM_TILE_X <= IMAGE_WIDTH/RES_DIVIDER, "every tile must be at least a pixel wide");
+static_assert(RES_DIVIDER > 0 && NUM_TILE_Y > 0 && NUM_TILE_Y <= IMAGE_HEIGHT/RES_DIVIDER, "every tile must be at least a pixel high");
 
-struct Tile {
-	size_t xStart, yStart;
-	size_t width, height;
+struct Options {
+	enum class Mode { Local, Coordinator, Worker, Server, Sequence, Reference, Benchmark };
+	
+	Mode mode = Mode::Local;
+	std::string address;
+	std::string scene = "default";
+	std::string output;
+	std::string framePattern;
+	std::string sceneDirectory;
+	size_t threads = NUM_WORKERS;
+	size_t cacheMegabytes = SCENE_CACHE_MB;
+	size_t textureMegabytes = TEXTURE_CACHE_MB;
+	size_t frameCount = 1;
+	size_t referenceSampleCount = REFERENCE_SAMPLE_COUNT;
+	std::string reference;
+	std::string report;
+	std::string trace;
+	std::string heatMap;
+	CoordinatorSettings coordinator;
+	BenchmarkSettings benchmark;
 };
 
-Vector3f color(const Rayf& ray, Hittable& world, int depth){
-	Hit hit;
-	
-	if( world.hit(ray, 0.001f, std::numeric_limits<float>::max(), hit) ){
-		Rayf scattered;
-		Vector3f attenuation;
-		
-		if( depth < 50 && hit.material->scatter(ray, hit, attenuation, scattered) )
-			return attenuation * color(scattered, world, depth + 1);
-		else
-			return Vector3f{0, 0, 0};
-	} else {
-		const float t = .5f * (ray.direction.normalized().y + 1.f);
-		return lerp(t, Vector3f{1.f, 1.f, 1.f}, Vector3f{0.5f, 0.7f, 1.0f});
-	}
+void printUsage(const char *program){
+	fprintf(stderr,
+			"usage: %s [--scene id] [--output image.ppm]\n"
+			"       %s --coordinator <address> [--scene id] [--batch tiles] [--timeout seconds] [--output image.ppm]\n"
+			"       %s --worker <address> [--scene id] [--threads count]\n"
+			"       %s --serve <address> [--threads count] [--cache-mb megabytes] [--scene-dir directory]\n"
+			"       %s --sequence <frame%%04d.ppm> --scene <path> [--frames count] [--threads count]\n"
+			"       %s --make-reference <image.pfm> [--scene id] [--samples count] [--threads count]\n"
+			"       %s --benchmark <reference.pfm> [--scene id] [--duration seconds] [--interval ms] [--target rmse] [--report file.csv|json]\n"
+			"every mode also takes [--texture-mb megabytes] to bound the memory image textures use\n"
+			"instrumented builds also take [--trace trace.json] [--heatmap cost.ppm] in every mode but --serve\n"
+			"scenes are 'default', 'spheres:<seed>' or the path to a scene description\n"
+			"addresses are host:port for TCP or unix:/path for a Unix socket\n",
+			program, program, program, program, program, program, program);
 }
 
-void renderTile(ImageRGBAUNorm& img, Hittable& world, const Camera& camera, const Tile& tile){
-	const size_t xStart = tile.xStart;
-	const size_t yStart = tile.yStart;
-	const size_t width = tile.width;
-	const size_t height = tile.height;
-	
-	for(size_t y=yStart; y < yStart + height; ++y){
-		for(size_t x=xStart; x < xStart + width; ++x){
-			Vector3f result = {0.f, 0.f, 0.f};
-			
-			for(size_t s=0; s < SAMPLE_COUNT; ++s){
-				const Vector2f uv = {
-					float(x + drand48()) / float(img.width()),
-					float(y + drand48()) / float(img.height()),
-				};
-				
-				const Rayf r = camera.rayFor(uv);
-				result += color(r, world, 0);
-			}
-			
-			result /= float(SAMPLE_COUNT);
-			
-			PixelRGBAUNorm& pixel = img.pixels()[y * img.width() + x];
-			pixel.r = static_cast<uint8_t>(sqrt(result.x) * 255);
-			pixel.g = static_cast<uint8_t>(sqrt(result.y) * 255);
-			pixel.b = static_cast<uint8_t>(sqrt(result.z) * 255);
-			pixel.a = 255;
-		}
-	}
-}
-
-void populateWorld(World& world){
-	world.add(new Sphere(Vector3f{0, -1000, 0}, 1000, new DiffuseMaterial(Vector3f{.5, .5, .5})));
-	
-	for(int a=-11; a < 11; ++a){
-		for(int b=-11; b < 11; ++b){
-			float chooseMaterial = drand48();
-			Vector3f center(a + 0.9f * drand48(), 0.2f, b + 0.9f * drand48());
-			Material *material = nullptr;
-			
-			if( (center - Vector3f{4.f, .2f, 0}).length() > 0.9f ){
-				const Vector3f color(drand48() * drand48(), 
-									 drand48() * drand48(), 
-									 drand48() * drand48());
-				
-				material = new DiffuseMaterial(color);
-			} else if( chooseMaterial < 0.95f ){
-				const Vector3f color(.5f * (1 + drand48()), 
-									 .5f * (1 + drand48()), 
-									 .5f * (1 + drand48()));
-				
-				material = new MetalMaterial(color, 0.5f * drand48());
-			} else {
-				material = new DielectricMaterial(1.5f);
-			}
-			
-			world.add(new Sphere(center, 0.2f, material));
+bool parseOptions(int argc, const char * argv[], Options& options){
+	for(int i=1; i < argc; ++i){
+		const char *arg = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+		
+		if( value == nullptr )
+			return false;
+		
+		if( strcmp(arg, "--coordinator") == 0 ){
+			options.mode = Options::Mode::Coordinator;
+			options.address = value;
+		} else if( strcmp(arg, "--worker") == 0 ){
+			options.mode = Options::Mode::Worker;
+			options.address = value;
+		} else if( strcmp(arg, "--serve") == 0 ){
+			options.mode = Options::Mode::Server;
+			options.address = value;
+		} else if( strcmp(arg, "--sequence") == 0 ){
+			options.mode = Options::Mode::Sequence;
+			options.framePattern = value;
+			if( !isValidFramePattern(options.framePattern) )
+				return false;
+		} else if( strcmp(arg, "--make-reference") == 0 ){
+			options.mode = Options::Mode::Reference;
+			options.reference = value;
+		} else if( strcmp(arg, "--benchmark") == 0 ){
+			options.mode = Options::Mode::Benchmark;
+			options.reference = value;
+		} else if( strcmp(arg, "--samples") == 0 ){
+			options.referenceSampleCount = strtoul(value, nullptr, 10);
+			if( options.referenceSampleCount == 0 )
+				return false;
+		} else if( strcmp(arg, "--duration") == 0 ){
+			options.benchmark.durationSeconds = strtod(value, nullptr);
+			if( options.benchmark.durationSeconds <= 0 )
+				return false;
+		} else if( strcmp(arg, "--interval") == 0 ){
+			options.benchmark.intervalMilliseconds = strtod(value, nullptr);
+			if( options.benchmark.intervalMilliseconds <= 0 )
+				return false;
+		} else if( strcmp(arg, "--target") == 0 ){
+			options.benchmark.targetRMSE = strtod(value, nullptr);
+		} else if( strcmp(arg, "--report") == 0 ){
+			options.report = value;
+		} else if( strcmp(arg, "--trace") == 0 && RT_INSTRUMENT ){
+			options.trace = value;
+		} else if( strcmp(arg, "--heatmap") == 0 && RT_INSTRUMENT ){
+			options.heatMap = value;
+		} else if( strcmp(arg, "--frames") == 0 ){
+			options.frameCount = strtoul(value, nullptr, 10);
+			if( options.frameCount == 0 )
+				return false;
+		} else if( strcmp(arg, "--cache-mb") == 0 ){
+			options.cacheMegabytes = strtoul(value, nullptr, 10);
+		} else if( strcmp(arg, "--texture-mb") == 0 ){
+			options.textureMegabytes = strtoul(value, nullptr, 10);
+		} else if( strcmp(arg, "--scene") == 0 ){
+			options.scene = value;
+		} else if( strcmp(arg, "--scene-dir") == 0 ){
+			options.sceneDirectory = value;
+		} else if( strcmp(arg, "--output") == 0 ){
+			options.output = value;
+		} else if( strcmp(arg, "--threads") == 0 ){
+			options.threads = strtoul(value, nullptr, 10);
+			if( options.threads == 0 )
+				return false;
+		} else if( strcmp(arg, "--batch") == 0 ){
+			options.coordinator.batchSize = strtoul(value, nullptr, 10);
+		} else if( strcmp(arg, "--timeout") == 0 ){
+			options.coordinator.timeoutSeconds = strtod(value, nullptr);
+			if( options.coordinator.timeoutSeconds <= 0 )
+				return false;
+		} else {
+			return false;
 		}
+		
+		++i;
 	}
 	
-	world.add(new Sphere(Vector3f{ 0, 1, 0}, 1.0f, new DielectricMaterial(1.5)));
-	world.add(new Sphere(Vector3f{-4, 1, 0}, 1.0f, new DiffuseMaterial(Vector3f{.4, .2, .1})));
-	world.add(new Sphere(Vector3f{ 4, 1, 0}, 1.0f, new MetalMaterial(Vector3f{.7, .6, .5}, 0)));
-}
-
-void generateTiles(std::queue<Tile>& tiles){
-	const size_t tileWidth = IMAGE_WIDTH/NUM_TILE_X;
-	const size_t tileHeight = IMAGE_HEIGHT/NUM_TILE_Y;
-	
-	for(size_t y=0; y < NUM_TILE_Y; ++y){
-		for(size_t x=0; x < NUM_TILE_X; ++x){
-			tiles.push({
-				x * tileWidth, y * tileHeight,
-				tileWidth, tileHeight,
-			});
-		}
-	}
+	// Sequences name their frames after the pattern alone
+	return options.mode != Options::Mode::Sequence || options.output.empty();
 }
 
 void updateWindowTitle(SDL_Window *window, size_t ms){
@@ -136,64 +170,201 @@ void updateWindowTitle(SDL_Window *window, size_t ms){
 	SDL_SetWindowTitle(window, title);
 }
 
+// Prints the counters and writes the requested trace and heat map of what was rendered so far
+void reportInstrumentation(const Options& options){
+#if RT_INSTRUMENT
+	printCounters(stdout, totalCounters());
+	
+	if( !options.trace.empty() && !writeChromeTrace(options.trace.c_str()) )
+		fprintf(stderr, "could not write the trace to '%s'\n", options.trace.c_str());
+	
+	if( !options.heatMap.empty() && !writeHeatMap(options.heatMap.c_str()) )
+		fprintf(stderr, "could not write the heat map to '%s'\n", options.heatMap.c_str());
+#endif
+}
+
+bool runBenchmark(const Options& options, const Hittable& world, const Camera& camera){
+	RenderPool pool(options.threads);
+	ImageRGBAF reference(IMAGE_WIDTH/RES_DIVIDER, IMAGE_HEIGHT/RES_DIVIDER);
+	
+	if( options.mode == Options::Mode::Reference ){
+		std::vector<Tile> tiles;
+		generateTiles(tiles, reference.width(), reference.height(), NUM_TILE_X, NUM_TILE_Y);
+		
+		const TileKernel kernel = selectKernel(kernelConfigFor(world, camera, options.referenceSampleCount, MAX_DEPTH));
+		
+		pool.submit(tiles, [&](const Tile& tile){
+			kernel(reference, world, camera, tile, options.referenceSampleCount, MAX_DEPTH);
+		})->wait();
+		
+		if( !writePFM(reference, options.reference.c_str()) ){
+			fprintf(stderr, "could not write the reference to '%s'\n", options.reference.c_str());
+			return false;
+		}
+		
+		return true;
+	}
+	
+	ImageRGBAF loaded;
+	if( !readPFM(loaded, options.reference.c_str()) ){
+		fprintf(stderr, "could not read the reference '%s'\n", options.reference.c_str());
+		return false;
+	}
+	
+	if( loaded.width() != reference.width() || loaded.height() != reference.height() ){
+		fprintf(stderr, "the reference is %zux%zu, the benchmark renders at %zux%zu\n",
+				loaded.width(), loaded.height(), reference.width(), reference.height());
+		return false;
+	}
+	
+	const std::vector<ConvergenceSample> samples = measureConvergence(world, camera, pool, loaded, options.benchmark);
+	
+	if( options.benchmark.targetRMSE > 0 ){
+		if( !samples.empty() && samples.back().rmse <= options.benchmark.targetRMSE )
+			printf("reached rmse %g in %.0fms\n", options.benchmark.targetRMSE, samples.back().milliseconds);
+		else
+			printf("did not reach rmse %g within %gs\n", options.benchmark.targetRMSE, options.benchmark.durationSeconds);
+	}
+	
+	if( !options.report.empty() && !writeConvergenceReport(samples, options.report) ){
+		fprintf(stderr, "could not write the report to '%s'\n", options.report.c_str());
+		return false;
+	}
+	
+	return true;
+}
+
 int main(int argc, const char * argv[]) {
+	Options options;
+	
+	if( !parseOptions(argc, argv, options) ){
+		printUsage(argv[0]);
+		return 1;
+	}
+	
+	TextureCache::shared().setMemoryBudget(options.textureMegabytes << 20);
+	
+	if( options.mode == Options::Mode::Server ){
+		RenderPool pool(options.threads);
+		SceneCache cache(options.cacheMegabytes << 20);
+		return runServer(options.address, pool, cache, options.sceneDirectory) ? 0 : 1;
+	}
+	
+	// Load the world we'll render
+	std::shared_ptr<Scene> scene = loadScene(options.scene);
+	
+	if( scene == nullptr ){
+		fprintf(stderr, "could not load scene '%s'\n", options.scene.c_str());
+		return 1;
+	}
+	
+	const Hittable& world = *scene->world;
+	
+	if( options.mode == Options::Mode::Worker ){
+		const bool success = runWorker(options.address, *scene, options.threads);
+		reportInstrumentation(options);
+		return success ? 0 : 1;
+	}
+	
+	if( options.mode == Options::Mode::Sequence ){
+		CompiledScene *compiled = dynamic_cast<CompiledScene*>(scene->world.get());
+		
+		if( compiled == nullptr ){
+			fprintf(stderr, "sequences are rendered from scene descriptions\n");
+			return 1;
+		}
+		
+		RenderPool pool(options.threads);
+		const SequenceSettings settings = {
+			options.framePattern, options.frameCount,
+			IMAGE_WIDTH/RES_DIVIDER, IMAGE_HEIGHT/RES_DIVIDER, SAMPLE_COUNT,
+		};
+		
+		const bool success = renderSequence(*compiled, pool, settings);
+		reportInstrumentation(options);
+		return success ? 0 : 1;
+	}
+	
+	if( options.mode == Options::Mode::Reference || options.mode == Options::Mode::Benchmark ){
+		const bool success = runBenchmark(options, world, scene->camera.makeCamera(ASPECT_RATIO));
+		reportInstrumentation(options);
+		return success ? 0 : 1;
+	}
+	
 	// Set up the rendering
+	ImageRGBAF buffer(IMAGE_WIDTH/RES_DIVIDER, IMAGE_HEIGHT/RES_DIVIDER);
 	ImageRGBAUNorm image(IMAGE_WIDTH/RES_DIVIDER, IMAGE_HEIGHT/RES_DIVIDER);
 	memset(image.pixels(), 0, sizeof(PixelRGBAUNorm) * image.width() * image.height());
 	
-	const Vector3f lookFrom = {13, 2, 3};
-	const Vector3f lookAt = {0, 0, 0};
-	const float distanceToFocus = 10;
-	const float aperture = 0.1f;
-	Camera camera(lookFrom, lookAt, Vector3f{0, 1, 0}, 20, ASPECT_RATIO, aperture, distanceToFocus);
-	
-	// Generate the world we'll render
-	World world;
-	populateWorld(world);
+	const Camera camera = scene->camera.makeCamera(ASPECT_RATIO);
+	const bool headless = !options.output.empty();
 	
 	// Start the window for displaying the image
-	SDL_Window *window; SDL_Renderer *renderer; SDL_Texture *texture;
-	SDL_Init(SDL_INIT_EVERYTHING);
-	SDL_CreateWindowAndRenderer(IMAGE_WIDTH, IMAGE_HEIGHT, SDL_WINDOW_SHOWN, &window, &renderer);
-	texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, IMAGE_WIDTH/RES_DIVIDER, IMAGE_HEIGHT/RES_DIVIDER);
+	SDL_Window *window = nullptr; SDL_Renderer *renderer = nullptr; SDL_Texture *texture = nullptr;
 	
-	// Generate the list of tiles to render
-	std::queue<Tile> tiles;
-	generateTiles(tiles);
+	if( !headless ){
+		SDL_Init(SDL_INIT_EVERYTHING);
+		SDL_CreateWindowAndRenderer(IMAGE_WIDTH, IMAGE_HEIGHT, SDL_WINDOW_SHOWN, &window, &renderer);
+		texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, IMAGE_WIDTH/RES_DIVIDER, IMAGE_HEIGHT/RES_DIVIDER);
+	}
 	
-	// Start the worker threads
-	std::thread workers[NUM_WORKERS];
-	std::mutex lock;
+	// Generate the list of tiles to render
+	std::vector<Tile> tiles;
+	generateTiles(tiles, image.width(), image.height(), NUM_TILE_X, NUM_TILE_Y);
 	
+	// Start rendering, the state finish uses outlives the threads that may call it
 	auto msStartTime = SDL_GetTicks();
 	bool finished = false;
 	
-	for(size_t i=0; i < NUM_WORKERS; ++i){
-		workers[i] = std::thread([&,i](){
-			while(true){
-				// Look for a tile to render
-				Tile tile;
-				
-				{
-					std::lock_guard<std::mutex> lg(lock);
-					if( tiles.empty() ){
-						if( !finished ){
-							finished = true;
-							auto msEndTime = SDL_GetTicks();
-							updateWindowTitle(window, msEndTime - msStartTime);
-						}
-						
-						return;
-					}
-					
-					tile = tiles.front();
-					tiles.pop();
-				}
-				
-				// Render the tile
-				renderTile(image, world, camera, tile);
-			}
+	auto finish = [&](){
+		finished = true;
+		auto msEndTime = SDL_GetTicks();
+		
+		if( headless )
+			printf("%ums|%zux%zu@%zu\n", msEndTime - msStartTime, image.width(), image.height(), SAMPLE_COUNT);
+		else
+			updateWindowTitle(window, msEndTime - msStartTime);
+		
+		reportInstrumentation(options);
+	};
+	
+	std::unique_ptr<RenderPool> pool;
+	std::shared_ptr<RenderPool::Job> job;
+	CoordinatorStop stopCoordinator;
+	std::thread coordinator;
+	
+	if( options.mode == Options::Mode::Coordinator ){
+		// Remote workers do the rendering, tiles are resolved as their results come in
+		coordinator = std::thread([&](){
+			const bool success = runCoordinator(options.address, buffer, scene->fingerprint, camera, SAMPLE_COUNT, tiles, options.coordinator, [&](const Tile& tile){
+				resolveTile(image, buffer, tile);
+			}, &stopCoordinator);
+			
+			if( success )
+				finish();
 		});
+	} else {
+		const TileKernel kernel = selectKernel(kernelConfigFor(world, camera, SAMPLE_COUNT, MAX_DEPTH));
+		
+		pool.reset(new RenderPool(options.threads));
+		job = pool->submit(tiles, [&, kernel](const Tile& tile){
+			kernel(buffer, world, camera, tile, SAMPLE_COUNT, MAX_DEPTH);
+			resolveTile(image, buffer, tile);
+		}, finish);
+	}
+	
+	if( headless ){
+		if( coordinator.joinable() )
+			coordinator.join();
+		if( job )
+			job->wait();
+		
+		if( !finished || !writePPM(image, options.output.c_str()) ){
+			fprintf(stderr, "could not render to '%s'\n", options.output.c_str());
+			return 1;
+		}
+		
+		return 0;
 	}
 	
 	// Update the stats in the window title
@@ -221,8 +392,15 @@ int main(int argc, const char * argv[]) {
 		SDL_RenderPresent(renderer);
 	}
 	
-	for(size_t i=0; i < NUM_WORKERS; ++i)
-		workers[i].join();
+	// Pending tiles are abandoned when the pool or the coordinator stops. The threads are stopped before
+	// the window is destroyed since the last tile to finish updates its title.
+	stopCoordinator.signal();
+	
+	if( coordinator.joinable() )
+		coordinator.join();
+	
+	job.reset();
+	pool.reset();
 	
 	SDL_DestroyRenderer(renderer);
 	SDL_DestroyWindow(window);
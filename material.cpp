@@ -1,18 +1,26 @@
 
 #include "./material.hpp"
 #include "./hittable.hpp"
+#include "./instrument.hpp"
+#include "./texture.hpp"
 
 bool DiffuseMaterial::scatter(const Rayf& inRay, const Hit& hit, Vector3f& attenuation, Rayf& scattered) const {
+	RT_COUNT(diffuseScatters);
+	RT_COUNT(diffuseRays);
+	
 	Vector3f target = hit.point + hit.normal + randomInUnitSphere<float>();
 	scattered = Rayf{hit.point, target - hit.point};
-	attenuation = albedo;
+	attenuation = texture ? albedo * texture->sample(hit.uv, hit.footprint) : albedo;
 	return true;
 }
 
 bool MetalMaterial::scatter(const Rayf& inRay, const Hit& hit, Vector3f& attenuation, Rayf& scattered) const {
+	RT_COUNT(metalScatters);
+	RT_COUNT(reflectedRays);
+	
 	Vector3f reflected = reflect(inRay.direction.normalized(), hit.normal);
 	scattered = Rayf{hit.point, reflected + fuzziness * randomInUnitSphere<float>()};
-	attenuation = albedo;
+	attenuation = texture ? albedo * texture->sample(hit.uv, hit.footprint) : albedo;
 	return dot(scattered.direction, hit.normal) > 0;
 }
 
@@ -38,6 +46,8 @@ namespace {
 }
 
 bool DielectricMaterial::scatter(const Rayf& inRay, const Hit& hit, Vector3f& attenuation, Rayf& scattered) const {
+	RT_COUNT(dielectricScatters);
+	
 	Vector3f outwardNormal;
 	Vector3f reflected = reflect(inRay.direction, hit.normal);
 	float niOverNt;
@@ -63,10 +73,13 @@ bool DielectricMaterial::scatter(const Rayf& inRay, const Hit& hit, Vector3f& at
 		reflectionProbability = 1.0f;
 	}
 	
-	if( drand48() < reflectionProbability )
+	if( drand48() < reflectionProbability ){
+		RT_COUNT(reflectedRays);
 		scattered = Rayf{hit.point, reflected};
-	else
+	} else {
+		RT_COUNT(refractedRays);
 		scattered = Rayf{hit.point, refracted};
+	}
 	
 	return true;
 }
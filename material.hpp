@@ -3,28 +3,42 @@
 
 #include "./math.hpp"
 
+#include <memory>
+
 struct Hit;
+struct Texture;
 
 struct Material {
 	virtual ~Material(){}
 	virtual bool scatter(const Rayf& inRay, const Hit& hit, Vector3f& attenuation, Rayf& scattered) const =0;
+	
+	// Whether scatter samples a texture, and so needs the footprint of the hit
+	virtual bool textured() const { return false; }
+	
+	// Whether this is a DiffuseMaterial, whose scatter kernels may then call directly
+	virtual bool diffuse() const { return false; }
 };
 
 struct DiffuseMaterial: public Material {
 	Vector3f albedo;
+	std::shared_ptr<const Texture> texture; // multiplies the albedo when set
 	
-	DiffuseMaterial(const Vector3f& a): albedo(a) {}
+	DiffuseMaterial(const Vector3f& a, std::shared_ptr<const Texture> t = nullptr): albedo(a), texture(std::move(t)) {}
 	
 	bool scatter(const Rayf& inRay, const Hit& hit, Vector3f& attenuation, Rayf& scattered) const override;
+	bool textured() const override { return texture != nullptr; }
+	bool diffuse() const override { return true; }
 };
 
 struct MetalMaterial: public Material {
 	Vector3f albedo;
 	float fuzziness;
+	std::shared_ptr<const Texture> texture; // multiplies the albedo when set
 	
-	MetalMaterial(const Vector3f& a, float f): albedo(a), fuzziness(f) {}
+	MetalMaterial(const Vector3f& a, float f, std::shared_ptr<const Texture> t = nullptr): albedo(a), fuzziness(f), texture(std::move(t)) {}
 	
 	bool scatter(const Rayf& inRay, const Hit& hit, Vector3f& attenuation, Rayf& scattered) const override;
+	bool textured() const override { return texture != nullptr; }
 };
 
 struct DielectricMaterial: public Material {
@@ -217,4 +217,57 @@ template<class T> struct Ray {
 using Rayf = Ray<float>;
 using Rayd = Ray<double>;
 
+// MARK: - AABB
+template<class T> struct AABB {
+	Vector3<T> min, max;
+	
+	static constexpr AABB empty() noexcept {
+		return {
+			Vector3<T>{INFINITY, INFINITY, INFINITY},
+			Vector3<T>{-INFINITY, -INFINITY, -INFINITY},
+		};
+	}
+	
+	constexpr void extend(const Vector3<T>& p) noexcept {
+		min = {std::fmin(min.x, p.x), std::fmin(min.y, p.y), std::fmin(min.z, p.z)};
+		max = {std::fmax(max.x, p.x), std::fmax(max.y, p.y), std::fmax(max.z, p.z)};
+	}
+	
+	constexpr void extend(const AABB& o) noexcept {
+		extend(o.min);
+		extend(o.max);
+	}
+	
+	[[nodiscard]] constexpr Vector3<T> center() const noexcept {
+		return T(0.5) * (min + max);
+	}
+	
+	[[nodiscard]] constexpr T surfaceArea() const noexcept {
+		const Vector3<T> d = max - min;
+		return T(2) * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+	
+	// Slab test against a ray whose inverse direction has been precomputed
+	[[nodiscard]] constexpr bool hit(const Ray<T>& r, const Vector3<T>& invDirection, T tMin, T tMax) const noexcept {
+		for(std::size_t axis=0; axis < 3; ++axis){
+			T t0 = (min[axis] - r.origin[axis]) * invDirection[axis];
+			T t1 = (max[axis] - r.origin[axis]) * invDirection[axis];
+			
+			if( invDirection[axis] < T(0) ){
+				const T t = t0; t0 = t1; t1 = t;
+			}
+			
+			tMin = t0 > tMin ? t0 : tMin;
+			tMax = t1 < tMax ? t1 : tMax;
+			
+			if( tMax < tMin )
+				return false;
+		}
+		
+		return true;
+	}
+};
+
+using AABBf = AABB<float>;
+
 #endif /* math_h */
@@ -0,0 +1,272 @@
+
+#include "./net.hpp"
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+namespace {
+	const char UNIX_PREFIX[] = "unix:";
+	
+	bool isUnixAddress(const std::string& address){
+		return address.compare(0, sizeof(UNIX_PREFIX) - 1, UNIX_PREFIX) == 0;
+	}
+	
+	bool makeUnixAddress(const std::string& address, sockaddr_un& addr){
+		const std::string path = address.substr(sizeof(UNIX_PREFIX) - 1);
+		
+		if( path.empty() || path.size() >= sizeof(addr.sun_path) ){
+			fprintf(stderr, "invalid unix socket path '%s'\n", path.c_str());
+			return false;
+		}
+		
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+		return true;
+	}
+	
+	addrinfo* resolveTcpAddress(const std::string& address, bool passive){
+		const size_t colon = address.rfind(':');
+		
+		if( colon == std::string::npos ){
+			fprintf(stderr, "invalid address '%s', expected host:port or unix:path\n", address.c_str());
+			return nullptr;
+		}
+		
+		const std::string host = address.substr(0, colon);
+		const std::string port = address.substr(colon + 1);
+		
+		addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = passive ? AI_PASSIVE : 0;
+		
+		addrinfo *result = nullptr;
+		const int err = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result);
+		
+		if( err != 0 ){
+			fprintf(stderr, "could not resolve '%s': %s\n", address.c_str(), gai_strerror(err));
+			return nullptr;
+		}
+		
+		return result;
+	}
+	
+	void configureSocket(int fd){
+		// Peers disappearing must surface as errors from send(), not kill the process
+		signal(SIGPIPE, SIG_IGN);
+		
+#ifdef SO_NOSIGPIPE
+		const int one = 1;
+		setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#else
+		(void)fd;
+#endif
+	}
+	
+	void configureTcpSocket(int fd){
+		const int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		
+		// Peers on machines that crashed or dropped off the network are noticed without any traffic
+		setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+		
+#ifdef TCP_USER_TIMEOUT
+		const unsigned int userTimeout = 60000;
+		setsockopt(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &userTimeout, sizeof(userTimeout));
+#endif
+	}
+}
+
+int listenOn(const std::string& address){
+	int fd = -1;
+	
+	if( isUnixAddress(address) ){
+		sockaddr_un addr;
+		if( !makeUnixAddress(address, addr) )
+			return -1;
+		
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		unlink(addr.sun_path);
+		
+		if( fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ){
+			perror("bind");
+			closeSocket(fd);
+			return -1;
+		}
+	} else {
+		addrinfo *info = resolveTcpAddress(address, true);
+		if( info == nullptr )
+			return -1;
+		
+		for(addrinfo *curr=info; curr != nullptr; curr = curr->ai_next){
+			fd = socket(curr->ai_family, curr->ai_socktype, curr->ai_protocol);
+			if( fd < 0 )
+				continue;
+			
+			const int one = 1;
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+			
+			if( bind(fd, curr->ai_addr, curr->ai_addrlen) == 0 )
+				break;
+			
+			closeSocket(fd);
+			fd = -1;
+		}
+		
+		freeaddrinfo(info);
+		
+		if( fd < 0 ){
+			fprintf(stderr, "could not bind to '%s'\n", address.c_str());
+			return -1;
+		}
+	}
+	
+	if( listen(fd, 64) != 0 ){
+		perror("listen");
+		closeSocket(fd);
+		return -1;
+	}
+	
+	configureSocket(fd);
+	return fd;
+}
+
+int connectTo(const std::string& address){
+	int fd = -1;
+	
+	if( isUnixAddress(address) ){
+		sockaddr_un addr;
+		if( !makeUnixAddress(address, addr) )
+			return -1;
+		
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		
+		if( fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ){
+			perror("connect");
+			closeSocket(fd);
+			return -1;
+		}
+	} else {
+		addrinfo *info = resolveTcpAddress(address, false);
+		if( info == nullptr )
+			return -1;
+		
+		for(addrinfo *curr=info; curr != nullptr; curr = curr->ai_next){
+			fd = socket(curr->ai_family, curr->ai_socktype, curr->ai_protocol);
+			if( fd < 0 )
+				continue;
+			
+			if( connect(fd, curr->ai_addr, curr->ai_addrlen) == 0 )
+				break;
+			
+			closeSocket(fd);
+			fd = -1;
+		}
+		
+		freeaddrinfo(info);
+		
+		if( fd < 0 ){
+			fprintf(stderr, "could not connect to '%s'\n", address.c_str());
+			return -1;
+		}
+		
+		configureTcpSocket(fd);
+	}
+	
+	configureSocket(fd);
+	return fd;
+}
+
+int acceptFrom(int listenFd){
+	sockaddr_storage addr;
+	socklen_t length = sizeof(addr);
+	const int fd = accept(listenFd, reinterpret_cast<sockaddr*>(&addr), &length);
+	
+	if( fd < 0 ){
+		perror("accept");
+		return -1;
+	}
+	
+	if( addr.ss_family != AF_UNIX )
+		configureTcpSocket(fd);
+	
+	configureSocket(fd);
+	return fd;
+}
+
+void closeSocket(int fd){
+	if( fd >= 0 )
+		close(fd);
+}
+
+bool sendAll(int fd, const void *data, size_t size){
+	const char *bytes = static_cast<const char*>(data);
+	
+	while( size > 0 ){
+		const ssize_t sent = send(fd, bytes, size, 0);
+		
+		if( sent < 0 && errno == EINTR )
+			continue;
+		if( sent <= 0 )
+			return false;
+		
+		bytes += sent;
+		size -= size_t(sent);
+	}
+	
+	return true;
+}
+
+bool recvAll(int fd, void *data, size_t size){
+	char *bytes = static_cast<char*>(data);
+	
+	while( size > 0 ){
+		const ssize_t received = recv(fd, bytes, size, 0);
+		
+		if( received < 0 && errno == EINTR )
+			continue;
+		if( received <= 0 )
+			return false;
+		
+		bytes += received;
+		size -= size_t(received);
+	}
+	
+	return true;
+}
+
+bool recvAvailable(int fd, std::vector<char>& buffer){
+	char chunk[65536];
+	
+	for(;;){
+		const ssize_t received = recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+		
+		if( received < 0 && errno == EINTR )
+			continue;
+		if( received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) )
+			return true;
+		if( received <= 0 )
+			return false;
+		
+		buffer.insert(buffer.end(), chunk, chunk + received);
+	}
+}
+
+void setSendTimeout(int fd, double seconds){
+	timeval timeout;
+	timeout.tv_sec = static_cast<time_t>(seconds);
+	timeout.tv_usec = static_cast<suseconds_t>((seconds - double(timeout.tv_sec)) * 1e6);
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
@@ -0,0 +1,24 @@
+#ifndef net_h
+#define net_h
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Addresses are either "unix:/path/to/socket" for a Unix domain socket or "host:port" for TCP.
+// All functions return -1 or false on failure after printing the reason to stderr.
+int listenOn(const std::string& address);
+int connectTo(const std::string& address);
+int acceptFrom(int listenFd);
+void closeSocket(int fd);
+
+bool sendAll(int fd, const void *data, size_t size);
+bool recvAll(int fd, void *data, size_t size);
+
+// Appends whatever has arrived on fd to buffer without waiting for more. Returns false once the peer is gone.
+bool recvAvailable(int fd, std::vector<char>& buffer);
+
+// Makes sends to a peer that stopped reading fail after seconds instead of blocking forever
+void setSendTimeout(int fd, double seconds);
+
+#endif /* net_h */
@@ -0,0 +1,500 @@
+
+#include "./parser.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+
+namespace {
+	struct Mesh {
+		uint32_t material;
+		std::vector<Vector3f> vertices;
+		std::vector<uint32_t> triangles;
+	};
+	
+	std::string directoryOf(const std::string& path){
+		const size_t slash = path.rfind('/');
+		return slash == std::string::npos ? "" : path.substr(0, slash + 1);
+	}
+	
+	class Parser {
+	public:
+		std::unique_ptr<CompiledScene> parse(const std::string& path, std::string& error){
+			if( !parseFile(path, false, error) )
+				return nullptr;
+			
+			return std::unique_ptr<CompiledScene>(new CompiledScene(std::move(contents_)));
+		}
+		
+	private:
+		// Reads the file one line at a time, OBJ files only contributing vertices and faces to the current mesh
+		bool parseFile(const std::string& path, bool obj, std::string& error){
+			std::ifstream file(path);
+			
+			if( !file ){
+				error = "could not open '" + path + "'";
+				return false;
+			}
+			
+			directory_ = directoryOf(path);
+			std::string line, keyword;
+			
+			for(size_t number=1; std::getline(file, line); ++number){
+				const size_t comment = line.find('#');
+				if( comment != std::string::npos )
+					line.resize(comment);
+				
+				std::istringstream tokens(line);
+				if( !(tokens >> keyword) )
+					continue;
+				
+				// Normals, texture coordinates, groups and such are of no use to us
+				if( obj && keyword != "v" && keyword != "f" )
+					continue;
+				
+				bool valid = obj ? parseMeshLine(keyword, tokens) : parseLine(keyword, tokens);
+				
+				std::string extra;
+				if( valid && tokens >> extra ){
+					error_ = "unexpected '" + extra + "'";
+					valid = false;
+				}
+				
+				if( !valid ){
+					error = path + ":" + std::to_string(number) + ": " + error_;
+					return false;
+				}
+			}
+			
+			if( !obj && inlineMesh_ ){
+				error = path + ": missing 'end' of mesh";
+				return false;
+			}
+			
+			return true;
+		}
+		
+		bool parseLine(const std::string& keyword, std::istringstream& tokens){
+			if( inlineMesh_ ){
+				if( keyword == "end" ){
+					inlineMesh_ = false;
+					return true;
+				}
+				
+				return parseMeshLine(keyword, tokens);
+			}
+			
+			if( keyword == "camera" )
+				return parseCamera(tokens, contents_.camera);
+			if( keyword == "texture" )
+				return parseTexture(tokens);
+			if( keyword == "material" )
+				return parseMaterial(tokens);
+			if( keyword == "sphere" )
+				return parseSphere(tokens);
+			if( keyword == "mesh" )
+				return parseMesh(tokens);
+			if( keyword == "instance" )
+				return parseInstance(tokens);
+			if( keyword == "key" )
+				return parseKeyframe(tokens);
+			
+			return fail("unknown keyword '" + keyword + "'");
+		}
+		
+		bool parseCamera(std::istringstream& tokens, CameraSettings& camera){
+			for(std::string key; tokens >> key;){
+				bool valid;
+				
+				if( key == "from" ) valid = read(tokens, camera.lookFrom);
+				else if( key == "at" ) valid = read(tokens, camera.lookAt);
+				else if( key == "up" ) valid = read(tokens, camera.up);
+				else if( key == "fov" ) valid = read(tokens, camera.degVerticalFov);
+				else if( key == "aperture" ) valid = read(tokens, camera.aperture);
+				else if( key == "focus" ) valid = read(tokens, camera.focusDistance);
+				else return fail("unknown camera setting '" + key + "'");
+				
+				if( !valid )
+					return fail("invalid value for camera " + key);
+			}
+			
+			return true;
+		}
+		
+		bool parseTexture(std::istringstream& tokens){
+			std::string name, type;
+			SceneTexture texture = {TextureType::Checker, {0, 0, 0}, {0, 0, 0}, 1.f, {}};
+			bool valid;
+			
+			if( !(tokens >> name >> type) )
+				return fail("expected texture name and type");
+			
+			if( type == "image" ){
+				std::string path;
+				char resolved[PATH_MAX];
+				
+				if( !(tokens >> path) )
+					return fail("expected image path");
+				if( path[0] != '/' )
+					path = directory_ + path;
+				
+				// Compiled scenes keep the absolute path so they can be loaded from any working directory
+				if( realpath(path.c_str(), resolved) == nullptr )
+					return fail("could not find '" + path + "'");
+				if( strlen(resolved) >= sizeof(texture.path) )
+					return fail("image path too long");
+				
+				texture.type = TextureType::Image;
+				strcpy(texture.path, resolved);
+				valid = true;
+			} else if( type == "checker" ){
+				valid = read(tokens, texture.even) && read(tokens, texture.odd) && read(tokens, texture.frequency);
+			} else {
+				return fail("unknown texture type '" + type + "'");
+			}
+			
+			if( !valid )
+				return fail("invalid " + type + " texture");
+			if( textureIds_.count(name) )
+				return fail("texture '" + name + "' defined twice");
+			
+			textureIds_[name] = static_cast<uint32_t>(contents_.textures.size());
+			contents_.textures.push_back(texture);
+			return true;
+		}
+		
+		bool parseMaterial(std::istringstream& tokens){
+			std::string name, type;
+			SceneMaterial material = {MaterialType::Diffuse, {0, 0, 0}, 0.f, 1.f, NO_TEXTURE};
+			bool valid;
+			
+			if( !(tokens >> name >> type) )
+				return fail("expected material name and type");
+			
+			if( type == "diffuse" ){
+				valid = read(tokens, material.albedo);
+			} else if( type == "metal" ){
+				material.type = MaterialType::Metal;
+				valid = read(tokens, material.albedo) && read(tokens, material.fuzziness);
+			} else if( type == "dielectric" ){
+				material.type = MaterialType::Dielectric;
+				valid = read(tokens, material.refractiveIndex);
+			} else {
+				return fail("unknown material type '" + type + "'");
+			}
+			
+			std::string key;
+			if( valid && material.type != MaterialType::Dielectric && tokens >> key ){
+				if( key != "texture" )
+					return fail("unexpected '" + key + "'");
+				if( !readTexture(tokens, material.texture) )
+					return false;
+			}
+			
+			if( !valid )
+				return fail("invalid " + type + " material");
+			if( materialIds_.count(name) )
+				return fail("material '" + name + "' defined twice");
+			
+			materialIds_[name] = static_cast<uint32_t>(contents_.materials.size());
+			contents_.materials.push_back(material);
+			return true;
+		}
+		
+		bool parseSphere(std::istringstream& tokens){
+			uint32_t material;
+			Vector3f center;
+			float radius;
+			
+			if( !readMaterial(tokens, material) )
+				return false;
+			if( !read(tokens, center) || !read(tokens, radius) || radius <= 0.f )
+				return fail("expected sphere center and positive radius");
+			
+			const size_t first = contents_.primitives.size();
+			contents_.primitives.push_back(ScenePrimitive::sphere(center, radius, material));
+			
+			std::string key;
+			if( tokens >> key ){
+				if( key != "name" )
+					return fail("unknown sphere setting '" + key + "'");
+				if( !parseName(tokens, first, center) )
+					return false;
+			}
+			
+			return true;
+		}
+		
+		bool parseMesh(std::istringstream& tokens){
+			std::string name, objPath;
+			
+			if( !(tokens >> name) )
+				return fail("expected mesh name");
+			if( meshes_.count(name) )
+				return fail("mesh '" + name + "' defined twice");
+			
+			Mesh& mesh = meshes_[name];
+			if( !readMaterial(tokens, mesh.material) )
+				return false;
+			
+			mesh_ = &mesh;
+			
+			if( !(tokens >> objPath) ){
+				inlineMesh_ = true;
+				return true;
+			}
+			
+			if( objPath[0] != '/' )
+				objPath = directory_ + objPath;
+			
+			std::string error;
+			const std::string directory = directory_;
+			const bool success = parseFile(objPath, true, error);
+			directory_ = directory;
+			
+			return success || fail(error);
+		}
+		
+		bool parseMeshLine(const std::string& keyword, std::istringstream& tokens){
+			if( keyword == "v" ){
+				Vector3f v;
+				if( !read(tokens, v) )
+					return fail("invalid vertex");
+				
+				mesh_->vertices.push_back(v);
+				return true;
+			}
+			
+			if( keyword == "f" ){
+				// Faces are triangulated as fans, vertex references being 1-based or negative from the last vertex
+				uint32_t first = 0, previous = 0;
+				size_t count = 0;
+				
+				for(std::string token; tokens >> token; ++count){
+					const long index = strtol(token.c_str(), nullptr, 10);
+					const long vertexCount = static_cast<long>(mesh_->vertices.size());
+					const long resolved = index < 0 ? vertexCount + index : index - 1;
+					
+					if( index == 0 || resolved < 0 || resolved >= vertexCount )
+						return fail("invalid face vertex '" + token + "'");
+					
+					const uint32_t vertex = static_cast<uint32_t>(resolved);
+					
+					if( count == 0 ){
+						first = vertex;
+					} else if( count >= 2 ){
+						mesh_->triangles.push_back(first);
+						mesh_->triangles.push_back(previous);
+						mesh_->triangles.push_back(vertex);
+					}
+					
+					previous = vertex;
+				}
+				
+				return count >= 3 || fail("faces need at least three vertices");
+			}
+			
+			return fail("unknown mesh keyword '" + keyword + "'");
+		}
+		
+		bool parseInstance(std::istringstream& tokens){
+			std::string name;
+			
+			if( !(tokens >> name) )
+				return fail("expected mesh name");
+			
+			auto found = meshes_.find(name);
+			if( found == meshes_.end() )
+				return fail("unknown mesh '" + name + "'");
+			
+			const Mesh& mesh = found->second;
+			uint32_t material = mesh.material;
+			float scale = 1.f, degrees = 0.f;
+			Vector3f translation = {0, 0, 0};
+			std::string objectName;
+			
+			for(std::string key; tokens >> key;){
+				bool valid;
+				
+				if( key == "material" ){
+					if( !readMaterial(tokens, material) )
+						return false;
+					
+					continue;
+				}
+				
+				if( key == "name" ){
+					if( !(tokens >> objectName) )
+						return fail("expected object name");
+					
+					continue;
+				}
+				
+				if( key == "scale" ) valid = read(tokens, scale);
+				else if( key == "rotate" ) valid = read(tokens, degrees);
+				else if( key == "translate" ) valid = read(tokens, translation);
+				else return fail("unknown instance setting '" + key + "'");
+				
+				if( !valid )
+					return fail("invalid value for instance " + key);
+			}
+			
+			const float c = std::cos(toRadians(degrees)), s = std::sin(toRadians(degrees));
+			const auto transform = [&](const Vector3f& p){
+				const Vector3f scaled = scale * p;
+				return Vector3f{c * scaled.x + s * scaled.z, scaled.y, -s * scaled.x + c * scaled.z} + translation;
+			};
+			
+			const size_t first = contents_.primitives.size();
+			
+			for(size_t i=0; i < mesh.triangles.size(); i += 3){
+				contents_.primitives.push_back(ScenePrimitive::triangle(transform(mesh.vertices[mesh.triangles[i]]),
+																		transform(mesh.vertices[mesh.triangles[i + 1]]),
+																		transform(mesh.vertices[mesh.triangles[i + 2]]),
+																		material));
+			}
+			
+			if( !objectName.empty() ){
+				std::istringstream name(objectName);
+				return parseName(name, first, translation);
+			}
+			
+			return true;
+		}
+		
+		// Names the primitives added since first as an object that keyframes can refer to
+		bool parseName(std::istringstream& tokens, size_t first, const Vector3f& anchor){
+			std::string name;
+			
+			if( !(tokens >> name) || name == "camera" )
+				return fail("expected object name");
+			if( objectIds_.count(name) )
+				return fail("object '" + name + "' defined twice");
+			
+			objectIds_[name] = static_cast<uint32_t>(contents_.objects.size());
+			contents_.objects.push_back({
+				static_cast<uint32_t>(first),
+				static_cast<uint32_t>(contents_.primitives.size() - first),
+				anchor,
+			});
+			return true;
+		}
+		
+		bool parseKeyframe(std::istringstream& tokens){
+			float time;
+			std::string target;
+			
+			if( !read(tokens, time) || !(tokens >> target) )
+				return fail("expected key time and target");
+			
+			if( target == "camera" ){
+				// Settings the key leaves out are those of the camera line
+				CameraKeyframe key = {time, contents_.camera};
+				contents_.cameraKeys.push_back(key);
+				return parseCamera(tokens, contents_.cameraKeys.back().camera);
+			}
+			
+			auto found = objectIds_.find(target);
+			if( found == objectIds_.end() )
+				return fail("unknown object '" + target + "'");
+			
+			ObjectKeyframe key = {found->second, time, {0, 0, 0}, 0.f};
+			
+			for(std::string setting; tokens >> setting;){
+				bool valid;
+				
+				if( setting == "translate" ) valid = read(tokens, key.translation);
+				else if( setting == "rotate" ) valid = read(tokens, key.degrees);
+				else return fail("unknown key setting '" + setting + "'");
+				
+				if( !valid )
+					return fail("invalid value for key " + setting);
+			}
+			
+			contents_.objectKeys.push_back(key);
+			return true;
+		}
+		
+		bool readTexture(std::istringstream& tokens, uint32_t& texture){
+			std::string name;
+			
+			if( !(tokens >> name) )
+				return fail("expected texture name");
+			
+			auto found = textureIds_.find(name);
+			if( found == textureIds_.end() )
+				return fail("unknown texture '" + name + "'");
+			
+			texture = found->second;
+			return true;
+		}
+		
+		bool readMaterial(std::istringstream& tokens, uint32_t& material){
+			std::string name;
+			
+			if( !(tokens >> name) )
+				return fail("expected material name");
+			
+			auto found = materialIds_.find(name);
+			if( found == materialIds_.end() )
+				return fail("unknown material '" + name + "'");
+			
+			material = found->second;
+			return true;
+		}
+		
+		static bool read(std::istringstream& tokens, float& value){
+			return bool(tokens >> value) && std::isfinite(value);
+		}
+		
+		static bool read(std::istringstream& tokens, Vector3f& value){
+			return read(tokens, value.x) && read(tokens, value.y) && read(tokens, value.z);
+		}
+		
+		bool fail(const std::string& error){
+			error_ = error;
+			return false;
+		}
+		
+		SceneContents contents_;
+		std::unordered_map<std::string, uint32_t> textureIds_;
+		std::unordered_map<std::string, uint32_t> materialIds_;
+		std::unordered_map<std::string, uint32_t> objectIds_;
+		std::unordered_map<std::string, Mesh> meshes_;
+		Mesh *mesh_ = nullptr;
+		bool inlineMesh_ = false;
+		std::string directory_;
+		std::string error_;
+	};
+}
+
+std::unique_ptr<CompiledScene> parseScene(const std::string& path, std::string& error){
+	Parser parser;
+	return parser.parse(path, error);
+}
+
+std::unique_ptr<CompiledScene> loadCompiledScene(const std::string& path, std::string& error){
+	SourceStamp stamp;
+	
+	if( !SourceStamp::of(path, stamp) ){
+		error = "could not open '" + path + "'";
+		return nullptr;
+	}
+	
+	const std::string cachePath = path + ".cache";
+	std::unique_ptr<CompiledScene> scene = CompiledScene::map(cachePath, stamp);
+	
+	if( scene != nullptr )
+		return scene;
+	
+	scene = parseScene(path, error);
+	
+	if( scene != nullptr && !scene->save(cachePath, stamp) )
+		fprintf(stderr, "could not save the compiled scene to '%s'\n", cachePath.c_str());
+	
+	return scene;
+}
@@ -0,0 +1,43 @@
+#ifndef parser_h
+#define parser_h
+
+#include "./compiled.hpp"
+
+#include <memory>
+#include <string>
+
+// Scene descriptions are text files read one line at a time, '#' starting a comment:
+//
+//   camera from 13 2 3 at 0 0 0 up 0 1 0 fov 20 aperture 0.1 focus 10
+//   texture <name> image <file.ppm>
+//   texture <name> checker <r> <g> <b> <r> <g> <b> <checks per unit>
+//   material <name> diffuse <r> <g> <b> [texture <name>]
+//   material <name> metal <r> <g> <b> <fuzziness> [texture <name>]
+//   material <name> dielectric <refractive index>
+//   sphere <material> <x> <y> <z> <radius> [name <object>]
+//   mesh <name> <material> [file.obj]
+//   v <x> <y> <z>
+//   f <vertex> <vertex> <vertex>...
+//   end
+//   instance <mesh> [material <name>] [scale <s>] [rotate <degrees about y>] [translate <x> <y> <z>] [name <object>]
+//   key <time> camera <camera settings>
+//   key <time> <object> [translate <x> <y> <z>] [rotate <degrees about y>]
+//
+// Textures multiply the albedo of the materials using them. Spheres are mapped by longitude and latitude,
+// triangles by their barycentric coordinates. Images are converted on first use into a tiled mip pyramid
+// saved next to them as `<image>.mip`.
+//
+// Meshes list their vertices and faces, as in an OBJ file, up to `end`, or read them from an OBJ file.
+// They are only templates: instances place copies of them in the scene, scaled, rotated then translated.
+// Every sphere and instanced triangle is flattened into the compiled scene.
+//
+// Keys animate named objects, moving them from where they were placed and rotating them about their
+// center or instance position, and the camera, whose keys default to the camera line's settings.
+// Between keys everything is linearly interpolated.
+std::unique_ptr<CompiledScene> parseScene(const std::string& path, std::string& error);
+
+// Loads the scene description at path from its compiled form, path + ".cache", when it is up to date,
+// or parses it and saves the compiled form for the next time.
+std::unique_ptr<CompiledScene> loadCompiledScene(const std::string& path, std::string& error);
+
+#endif /* parser_h */
@@ -0,0 +1,120 @@
+
+#include "./pool.hpp"
+
+#include "./instrument.hpp"
+
+#include <cassert>
+
+// MARK: - Job
+void RenderPool::Job::wait(){
+	std::unique_lock<std::mutex> lk(lock_);
+	finished_.wait(lk, [this](){ return completed_; });
+}
+
+bool RenderPool::Job::done(){
+	std::lock_guard<std::mutex> lg(lock_);
+	return completed_;
+}
+
+void RenderPool::Job::complete(){
+	if( completion_ )
+		completion_();
+	
+	{
+		std::lock_guard<std::mutex> lg(lock_);
+		completed_ = true;
+	}
+	
+	finished_.notify_all();
+}
+
+// MARK: - RenderPool
+RenderPool::RenderPool(size_t numThreads){
+	assert(numThreads > 0);
+	
+	for(size_t i=0; i < numThreads; ++i)
+		threads_.emplace_back([this, i](){
+			nameThread("pool %zu", i);
+			work();
+		});
+}
+
+RenderPool::~RenderPool(){
+	{
+		std::lock_guard<std::mutex> lg(lock_);
+		stopping_ = true;
+	}
+	
+	available_.notify_all();
+	
+	for(std::thread& t: threads_)
+		t.join();
+}
+
+std::shared_ptr<RenderPool::Job> RenderPool::submit(size_t count, std::function<void(size_t)> run,
+													std::function<void()> completion){
+	std::shared_ptr<Job> job = std::make_shared<Job>();
+	job->count_ = count;
+	job->run_ = std::move(run);
+	job->completion_ = std::move(completion);
+	job->remaining_ = count;
+	
+	if( count == 0 ){
+		job->complete();
+		return job;
+	}
+	
+	{
+		std::lock_guard<std::mutex> lg(lock_);
+		jobs_.push_back(job);
+	}
+	
+	available_.notify_all();
+	return job;
+}
+
+std::shared_ptr<RenderPool::Job> RenderPool::submit(std::vector<Tile> tiles, std::function<void(const Tile&)> render,
+													std::function<void()> completion){
+	const size_t count = tiles.size();
+	
+	return submit(count, [tiles = std::move(tiles), render = std::move(render)](size_t i){
+		render(tiles[i]);
+	}, std::move(completion));
+}
+
+void RenderPool::work(){
+	while(true){
+		// Take the next task of the next job in round robin order
+		std::shared_ptr<Job> job;
+		size_t task;
+		
+		{
+			std::unique_lock<std::mutex> lk(lock_);
+			available_.wait(lk, [this](){ return stopping_ || !jobs_.empty(); });
+			
+			if( stopping_ )
+				return;
+			
+			cursor_ %= jobs_.size();
+			job = jobs_[cursor_];
+			task = job->next_++;
+			
+			if( job->next_ == job->count_ )
+				jobs_.erase(jobs_.begin() + cursor_);
+			else
+				++cursor_;
+		}
+		
+		job->run_(task);
+		
+		bool finished;
+		
+		{
+			std::lock_guard<std::mutex> lg(job->lock_);
+			finished = --job->remaining_ == 0;
+		}
+		
+		if( finished )
+			job->complete();
+	}
+}
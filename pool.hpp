@@ -0,0 +1,63 @@
+#ifndef pool_h
+#define pool_h
+
+#include "./render.hpp"
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Worker threads shared by any number of concurrent jobs. Threads take tasks, usually tiles, from the
+// active jobs in turn, so a large job cannot starve the ones submitted after it.
+class RenderPool {
+public:
+	class Job {
+	public:
+		void wait();
+		bool done();
+		
+	private:
+		friend class RenderPool;
+		
+		void complete();
+		
+		size_t count_ = 0;
+		std::function<void(size_t)> run_;
+		std::function<void()> completion_;
+		size_t next_ = 0;
+		size_t remaining_ = 0;
+		bool completed_ = false;
+		std::mutex lock_;
+		std::condition_variable finished_;
+	};
+	
+	explicit RenderPool(size_t numThreads);
+	~RenderPool();
+	
+	RenderPool(const RenderPool&) = delete;
+	RenderPool& operator=(const RenderPool&) = delete;
+	
+	size_t size() const noexcept { return threads_.size(); }
+	
+	// run is called on the pool threads for every index below count, completion on the thread finishing the last one
+	std::shared_ptr<Job> submit(size_t count, std::function<void(size_t)> run,
+								std::function<void()> completion = nullptr);
+	
+	std::shared_ptr<Job> submit(std::vector<Tile> tiles, std::function<void(const Tile&)> render,
+								std::function<void()> completion = nullptr);
+	
+private:
+	void work();
+	
+	std::vector<std::thread> threads_;
+	std::vector<std::shared_ptr<Job>> jobs_;
+	size_t cursor_ = 0;
+	bool stopping_ = false;
+	std::mutex lock_;
+	std::condition_variable available_;
+};
+
+#endif /* pool_h */
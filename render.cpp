@@ -0,0 +1,178 @@
+
+#include "./render.hpp"
+#include "./hittable.hpp"
+#include "./camera.hpp"
+#include "./material.hpp"
+#include "./instrument.hpp"
+
+#include <limits>
+#include <cassert>
+
+namespace {
+	// Samples per pixel from which sums are kept as doubles
+	constexpr size_t DOUBLE_PRECISION_SAMPLES = 1024;
+	
+	// MaxDepth is the depth limit, or 0 to use maxDepth instead
+	template<int MaxDepth, unsigned Features>
+	Vector3f color(const Rayf& ray, const RayDifferential& differential, const Hittable& world, int depth, int maxDepth){
+		const int limit = MaxDepth > 0 ? MaxDepth : maxDepth;
+		Hit hit;
+		
+		if( world.hit(ray, 0.001f, std::numeric_limits<float>::max(), hit) ){
+			Rayf scattered;
+			Vector3f attenuation;
+			
+			if( Features & TextureFiltering )
+				hit.footprint = differential.footprint(hit.point, hit.normal) / hit.uvScale;
+			
+			// Diffuse materials always scatter, the remaining material types are never reached
+			const bool scatters = (Features & DiffuseOnly) ?
+				depth < limit && static_cast<const DiffuseMaterial*>(hit.material)->DiffuseMaterial::scatter(ray, hit, attenuation, scattered) :
+				depth < limit && hit.material->scatter(ray, hit, attenuation, scattered);
+			
+			if( scatters ){
+				RT_COUNT(bounces);
+				
+				if( Features & TextureFiltering ){
+					const RayDifferential next = differential.scattered(ray, scattered, hit.normal);
+					return attenuation * color<MaxDepth, Features>(scattered, next, world, depth + 1, maxDepth);
+				}
+				
+				return attenuation * color<MaxDepth, Features>(scattered, differential, world, depth + 1, maxDepth);
+			}
+			
+			if( depth < limit )
+				RT_COUNT(absorbedPaths);
+			else
+				RT_COUNT(depthLimitedPaths);
+			
+			return Vector3f{0, 0, 0};
+		} else {
+			RT_COUNT(escapedPaths);
+			const float t = .5f * (ray.direction.normalized().y + 1.f);
+			return lerp(t, Vector3f{1.f, 1.f, 1.f}, Vector3f{0.5f, 0.7f, 1.0f});
+		}
+	}
+	
+	template<class Real, bool Lens, int MaxDepth, unsigned Features>
+	void renderTileKernel(ImageRGBAF& img, const Hittable& world, const Camera& camera, const Tile& tile,
+						  size_t sampleCount, int maxDepth){
+		const size_t xStart = tile.xStart;
+		const size_t yStart = tile.yStart;
+		const size_t width = tile.width;
+		const size_t height = tile.height;
+		const Vector2f pixelSize = {1.f / float(img.width()), 1.f / float(img.height())};
+		RayDifferential differential = {}; // only written and read with TextureFiltering
+		TileProfile profile(tile);
+		
+		for(size_t y=yStart; y < yStart + height; ++y){
+			for(size_t x=xStart; x < xStart + width; ++x){
+				Vector3<Real> result = {0, 0, 0};
+				
+				for(size_t s=0; s < sampleCount; ++s){
+					const Vector2f uv = {
+						float(x + drand48()) / float(img.width()),
+						float(y + drand48()) / float(img.height()),
+					};
+					
+					const Rayf r = camera.rayFor<Lens, (Features & TextureFiltering) != 0>(uv, pixelSize, differential);
+					RT_COUNT(cameraRays);
+					
+					const Vector3f c = color<MaxDepth, Features>(r, differential, world, 0, maxDepth);
+					result += Vector3<Real>{c.x, c.y, c.z};
+				}
+				
+				result /= Real(sampleCount);
+				
+				PixelRGBAF& pixel = img.pixels()[y * img.width() + x];
+				pixel.r = float(result.x);
+				pixel.g = float(result.y);
+				pixel.b = float(result.z);
+				pixel.a = 1.f;
+				
+				profile.pixelDone();
+			}
+		}
+	}
+	
+	// Each step of the dispatch resolves one parameter, those before it being fixed by the template arguments
+	template<class Real, bool Lens, int MaxDepth>
+	TileKernel selectFeatures(unsigned features){
+		switch(features & (TextureFiltering | DiffuseOnly)){
+			case TextureFiltering | DiffuseOnly: return &renderTileKernel<Real, Lens, MaxDepth, TextureFiltering | DiffuseOnly>;
+			case TextureFiltering: return &renderTileKernel<Real, Lens, MaxDepth, TextureFiltering>;
+			case DiffuseOnly: return &renderTileKernel<Real, Lens, MaxDepth, DiffuseOnly>;
+			default: return &renderTileKernel<Real, Lens, MaxDepth, 0>;
+		}
+	}
+	
+	// Depths of the default render and of quick previews
+	template<class Real, bool Lens>
+	TileKernel selectDepth(int maxDepth, unsigned features){
+		switch(maxDepth){
+			case MAX_DEPTH: return selectFeatures<Real, Lens, MAX_DEPTH>(features);
+			case 8: return selectFeatures<Real, Lens, 8>(features);
+			default: return selectFeatures<Real, Lens, 0>(features);
+		}
+	}
+	
+	template<class Real>
+	TileKernel selectLens(bool lens, int maxDepth, unsigned features){
+		return lens ? selectDepth<Real, true>(maxDepth, features) : selectDepth<Real, false>(maxDepth, features);
+	}
+}
+
+KernelConfig kernelConfigFor(const Hittable& world, const Camera& camera, size_t sampleCount, int maxDepth){
+	return {
+		sampleCount >= DOUBLE_PRECISION_SAMPLES,
+		camera.lensRadius > 0.f,
+		maxDepth,
+		(world.textured() ? unsigned(TextureFiltering) : 0u) | (world.diffuseOnly() ? unsigned(DiffuseOnly) : 0u),
+	};
+}
+
+TileKernel selectKernel(const KernelConfig& config){
+	if( config.doublePrecision )
+		return selectLens<double>(config.lens, config.maxDepth, config.features);
+	
+	return selectLens<float>(config.lens, config.maxDepth, config.features);
+}
+
+void resolveTile(ImageRGBAUNorm& dst, const ImageRGBAF& src, const Tile& tile){
+	assert(dst.width() == src.width() && dst.height() == src.height());
+	
+	for(size_t y=tile.yStart; y < tile.yStart + tile.height; ++y){
+		for(size_t x=tile.xStart; x < tile.xStart + tile.width; ++x){
+			const PixelRGBAF& in = src.pixels()[y * src.width() + x];
+			PixelRGBAUNorm& out = dst.pixels()[y * dst.width() + x];
+			
+			out.r = static_cast<uint8_t>(sqrt(clamp(in.r, 0.f, 1.f)) * 255);
+			out.g = static_cast<uint8_t>(sqrt(clamp(in.g, 0.f, 1.f)) * 255);
+			out.b = static_cast<uint8_t>(sqrt(clamp(in.b, 0.f, 1.f)) * 255);
+			out.a = 255;
+		}
+	}
+}
+
+void generateTiles(std::vector<Tile>& tiles, size_t imageWidth, size_t imageHeight, size_t numTileX, size_t numTileY){
+	// Tiles differ by at most a pixel when the image does not divide evenly
+	for(size_t y=0; y < numTileY; ++y){
+		const size_t yStart = y * imageHeight / numTileY;
+		const size_t yEnd = (y + 1) * imageHeight / numTileY;
+		
+		for(size_t x=0; x < numTileX; ++x){
+			const size_t xStart = x * imageWidth / numTileX;
+			const size_t xEnd = (x + 1) * imageWidth / numTileX;
+			
+			tiles.push_back({
+				xStart, yStart,
+				xEnd - xStart, yEnd - yStart,
+			});
+		}
+	}
+}
+
+void generateTilesOfSize(std::vector<Tile>& tiles, size_t imageWidth, size_t imageHeight, size_t tileSize){
+	assert(tileSize > 0);
+	generateTiles(tiles, imageWidth, imageHeight, (imageWidth + tileSize - 1) / tileSize, (imageHeight + tileSize - 1) / tileSize);
+}
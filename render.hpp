@@ -0,0 +1,57 @@
+#ifndef render_h
+#define render_h
+
+#include "./math.hpp"
+#include "./image.hpp"
+
+#include <vector>
+
+struct Hittable;
+struct Camera;
+struct RayDifferential;
+
+struct Tile {
+	size_t xStart, yStart;
+	size_t width, height;
+};
+
+// Bounces after which paths are cut off
+constexpr int MAX_DEPTH = 50;
+
+// MARK: - Kernels
+// Tiles are rendered by kernels specialized at compile time on what would otherwise be checked for every
+// sample or bounce: the precision samples are summed in, whether the camera has a lens, the depth limit,
+// and the optional features of the integrator. Renders pick the one matching them once, then call it per tile.
+enum KernelFeature: unsigned {
+	TextureFiltering = 1 << 0, // carry ray differentials to size the footprint textures are filtered over
+	DiffuseOnly = 1 << 1,      // scatter off diffuse materials only, without dispatching on the material
+};
+
+struct KernelConfig {
+	bool doublePrecision; // sum samples as doubles, for renders with thousands of samples per pixel
+	bool lens;
+	int maxDepth;
+	unsigned features;
+};
+
+// Renders the tile into the linear float image, averaging sampleCount samples per pixel
+using TileKernel = void (*)(ImageRGBAF& img, const Hittable& world, const Camera& camera, const Tile& tile,
+							size_t sampleCount, int maxDepth);
+
+KernelConfig kernelConfigFor(const Hittable& world, const Camera& camera, size_t sampleCount, int maxDepth);
+
+// Depth limits without a kernel of their own are handled by one checking them at runtime
+TileKernel selectKernel(const KernelConfig& config);
+
+// Gamma corrects and quantizes a tile of the float image into the displayable image
+void resolveTile(ImageRGBAUNorm& dst, const ImageRGBAF& src, const Tile& tile);
+
+void generateTiles(std::vector<Tile>& tiles, size_t imageWidth, size_t imageHeight, size_t numTileX, size_t numTileY);
+
+// Small enough for many tiles per thread at any resolution, so threads finishing early find more work
+constexpr size_t TILE_SIZE = 32;
+
+// Tiles of about tileSize pixels square covering the image
+void generateTilesOfSize(std::vector<Tile>& tiles, size_t imageWidth, size_t imageHeight, size_t tileSize = TILE_SIZE);
+
+#endif /* render_h */
@@ -0,0 +1,160 @@
+
+#include "./scene.hpp"
+#include "./world.hpp"
+#include "./material.hpp"
+#include "./parser.hpp"
+
+#include <sys/stat.h>
+
+#include <cstdlib>
+#include <cstdio>
+
+void populateWorld(World& world, long seed){
+	// Use our own generator state, as seeded by srand48, so that concurrent renders do not perturb the scene
+	unsigned short state[3] = {0x330E, static_cast<unsigned short>(seed), static_cast<unsigned short>(seed >> 16)};
+	const auto drand48 = [&](){ return erand48(state); };
+	
+	world.add(new Sphere(Vector3f{0, -1000, 0}, 1000, new DiffuseMaterial(Vector3f{.5, .5, .5})));
+	
+	for(int a=-11; a < 11; ++a){
+		for(int b=-11; b < 11; ++b){
+			float chooseMaterial = drand48();
+			Vector3f center(a + 0.9f * drand48(), 0.2f, b + 0.9f * drand48());
+			Material *material = nullptr;
+			
+			if( (center - Vector3f{4.f, .2f, 0}).length() > 0.9f ){
+				const Vector3f color(drand48() * drand48(), 
+									 drand48() * drand48(), 
+									 drand48() * drand48());
+				
+				material = new DiffuseMaterial(color);
+			} else if( chooseMaterial < 0.95f ){
+				const Vector3f color(.5f * (1 + drand48()), 
+									 .5f * (1 + drand48()), 
+									 .5f * (1 + drand48()));
+				
+				material = new MetalMaterial(color, 0.5f * drand48());
+			} else {
+				material = new DielectricMaterial(1.5f);
+			}
+			
+			world.add(new Sphere(center, 0.2f, material));
+		}
+	}
+	
+	world.add(new Sphere(Vector3f{ 0, 1, 0}, 1.0f, new DielectricMaterial(1.5)));
+	world.add(new Sphere(Vector3f{-4, 1, 0}, 1.0f, new DiffuseMaterial(Vector3f{.4, .2, .1})));
+	world.add(new Sphere(Vector3f{ 4, 1, 0}, 1.0f, new MetalMaterial(Vector3f{.7, .6, .5}, 0)));
+}
+
+namespace {
+	const char SPHERES_PREFIX[] = "spheres:";
+	
+	// FNV-1a
+	uint64_t fingerprint(const void *data, size_t size, uint64_t hash = 0xcbf29ce484222325){
+		const unsigned char *bytes = static_cast<const unsigned char*>(data);
+		
+		for(size_t i=0; i < size; ++i)
+			hash = (hash ^ bytes[i]) * 0x100000001b3;
+		
+		return hash;
+	}
+	
+	bool fingerprintFile(const std::string& path, uint64_t& hash){
+		FILE *file = fopen(path.c_str(), "rb");
+		if( file == nullptr )
+			return false;
+		
+		char chunk[65536];
+		hash = fingerprint("file:", 5);
+		
+		for(size_t size; (size = fread(chunk, 1, sizeof(chunk), file)) > 0;)
+			hash = fingerprint(chunk, size, hash);
+		
+		const bool success = !ferror(file);
+		fclose(file);
+		return success;
+	}
+}
+
+bool SourceStamp::of(const std::string& path, SourceStamp& stamp){
+	struct stat info;
+	
+	if( stat(path.c_str(), &info) != 0 )
+		return false;
+	
+#ifdef __APPLE__
+	const timespec& modified = info.st_mtimespec;
+#else
+	const timespec& modified = info.st_mtim;
+#endif
+	
+	stamp.size = static_cast<uint64_t>(info.st_size);
+	stamp.modificationTime = int64_t(modified.tv_sec) * 1000000000 + modified.tv_nsec;
+	return true;
+}
+
+bool Scene::stale() const {
+	SourceStamp current;
+	return !sourcePath.empty() && !(SourceStamp::of(sourcePath, current) && current == source);
+}
+
+Camera CameraSettings::makeCamera(float aspect) const {
+	return Camera(lookFrom, lookAt, up, degVerticalFov, aspect, aperture, focusDistance);
+}
+
+std::shared_ptr<Scene> loadScene(const std::string& id){
+	long seed = DEFAULT_SCENE_SEED;
+	
+	if( id.compare(0, sizeof(SPHERES_PREFIX) - 1, SPHERES_PREFIX) == 0 ){
+		char *end = nullptr;
+		const char *digits = id.c_str() + sizeof(SPHERES_PREFIX) - 1;
+		seed = strtol(digits, &end, 0);
+		
+		if( end == digits || *end != '\0' )
+			return nullptr;
+	} else if( id != "default" ){
+		// Stamped before loading, so that edits made meanwhile make the scene stale
+		std::shared_ptr<Scene> scene = std::make_shared<Scene>();
+		scene->sourcePath = id;
+		
+		if( !SourceStamp::of(id, scene->source) ){
+			perror(id.c_str());
+			return nullptr;
+		}
+		
+		std::string error;
+		std::unique_ptr<CompiledScene> compiled = loadCompiledScene(id, error);
+		
+		if( compiled == nullptr ){
+			fprintf(stderr, "%s\n", error.c_str());
+			return nullptr;
+		}
+		
+		scene->camera = compiled->camera();
+		scene->memoryUsage = compiled->memoryUsage();
+		scene->world = std::move(compiled);
+		
+		if( !fingerprintFile(id, scene->fingerprint) ){
+			perror(id.c_str());
+			return nullptr;
+		}
+		
+		return scene;
+	}
+	
+	World *world = new World();
+	populateWorld(*world, seed);
+	world->build();
+	
+	std::shared_ptr<Scene> scene = std::make_shared<Scene>();
+	scene->world.reset(world);
+	scene->memoryUsage = world->memoryUsage();
+	scene->fingerprint = fingerprint(SPHERES_PREFIX, sizeof(SPHERES_PREFIX) - 1);
+	scene->fingerprint = fingerprint(&seed, sizeof(seed), scene->fingerprint);
+	return scene;
+}
+
+bool isBuiltinScene(const std::string& id){
+	return id == "default" || id.compare(0, sizeof(SPHERES_PREFIX) - 1, SPHERES_PREFIX) == 0;
+}
@@ -0,0 +1,60 @@
+#ifndef scene_h
+#define scene_h
+
+#include "./camera.hpp"
+#include "./hittable.hpp"
+
+#include <memory>
+#include <string>
+#include <cstdint>
+
+class World;
+
+// drand48's own default seed, so the default scene is the one the renderer always showed
+static constexpr long DEFAULT_SCENE_SEED = 0x1234ABCD;
+
+void populateWorld(World& world, long seed = DEFAULT_SCENE_SEED);
+
+struct CameraSettings {
+	Vector3f lookFrom = {13, 2, 3};
+	Vector3f lookAt = {0, 0, 0};
+	Vector3f up = {0, 1, 0};
+	float degVerticalFov = 20;
+	float aperture = 0.1f;
+	float focusDistance = 10;
+	
+	Camera makeCamera(float aspect) const;
+};
+
+// Identifies the version of a scene description a scene or compiled scene was built from
+struct SourceStamp {
+	uint64_t size;
+	int64_t modificationTime; // nanoseconds
+	
+	static bool of(const std::string& path, SourceStamp& stamp);
+	bool operator==(const SourceStamp& o) const noexcept { return size == o.size && modificationTime == o.modificationTime; }
+};
+
+// A scene ready to be traced, its acceleration structure built
+struct Scene {
+	std::unique_ptr<Hittable> world;
+	CameraSettings camera;
+	size_t memoryUsage = 0;
+	uint64_t fingerprint = 0; // equal for the same scene loaded on different machines or from different paths
+	
+	// The scene description it was loaded from, empty for built-in scenes
+	std::string sourcePath;
+	SourceStamp source = {};
+	
+	// Whether the scene description changed or went away since the scene was loaded
+	bool stale() const;
+};
+
+// Scene ids are "default" or "spheres:<seed>" for the random spheres of populateWorld,
+// anything else is the path to a scene description. Returns nullptr if the scene cannot be loaded.
+std::shared_ptr<Scene> loadScene(const std::string& id);
+
+// Whether id names one of the scenes generated by populateWorld rather than a file
+bool isBuiltinScene(const std::string& id);
+
+#endif /* scene_h */
@@ -0,0 +1,168 @@
+
+#include "./sequence.hpp"
+#include "./compiled.hpp"
+#include "./pool.hpp"
+#include "./render.hpp"
+#include "./image.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdio>
+#include <cctype>
+#include <cassert>
+
+namespace {
+	// Resolves, encodes and writes one frame at a time on its own thread
+	class FrameWriter {
+	public:
+		FrameWriter(): thread_([this](){ work(); }) {}
+		
+		~FrameWriter(){
+			{
+				std::lock_guard<std::mutex> lg(lock_);
+				stopping_ = true;
+			}
+			
+			changed_.notify_all();
+			thread_.join();
+		}
+		
+		// Waits for the previous frame to be written, the frame must stay untouched until the next call
+		void write(const ImageRGBAF& frame, const std::string& path){
+			std::unique_lock<std::mutex> lk(lock_);
+			changed_.wait(lk, [this](){ return frame_ == nullptr; });
+			frame_ = &frame;
+			path_ = path;
+			lk.unlock();
+			changed_.notify_all();
+		}
+		
+		bool finish(){
+			std::unique_lock<std::mutex> lk(lock_);
+			changed_.wait(lk, [this](){ return frame_ == nullptr; });
+			return !failed_;
+		}
+		
+	private:
+		void work(){
+			ImageRGBAUNorm image;
+			std::vector<uint8_t> encoded;
+			
+			while(true){
+				std::unique_lock<std::mutex> lk(lock_);
+				changed_.wait(lk, [this](){ return stopping_ || frame_ != nullptr; });
+				
+				if( frame_ == nullptr )
+					return;
+				
+				const ImageRGBAF& frame = *frame_;
+				const std::string path = path_;
+				lk.unlock();
+				
+				if( image.width() != frame.width() || image.height() != frame.height() )
+					image.assign(frame.width(), frame.height());
+				
+				resolveTile(image, frame, Tile{0, 0, frame.width(), frame.height()});
+				encodePPM(image, encoded);
+				const bool written = writeFile(path.c_str(), encoded);
+				
+				if( !written )
+					fprintf(stderr, "could not write '%s'\n", path.c_str());
+				
+				lk.lock();
+				failed_ = failed_ || !written;
+				frame_ = nullptr;
+				lk.unlock();
+				changed_.notify_all();
+			}
+		}
+		
+		const ImageRGBAF *frame_ = nullptr;
+		std::string path_;
+		bool failed_ = false;
+		bool stopping_ = false;
+		std::mutex lock_;
+		std::condition_variable changed_;
+		std::thread thread_;
+	};
+	
+	std::string framePath(const std::string& pattern, size_t frame){
+		char path[4096];
+		snprintf(path, sizeof(path), pattern.c_str(), int(frame));
+		return path;
+	}
+	
+	double millisecondsSince(std::chrono::steady_clock::time_point start){
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+bool isValidFramePattern(const std::string& pattern){
+	// Exactly one integer conversion, optionally zero padded, as the pattern is given to snprintf
+	size_t conversions = 0;
+	
+	for(size_t i=0; i < pattern.size(); ++i){
+		if( pattern[i] != '%' )
+			continue;
+		
+		if( i + 1 < pattern.size() && pattern[i + 1] == '%' ){
+			++i;
+			continue;
+		}
+		
+		size_t j = i + 1;
+		while( j < pattern.size() && isdigit(static_cast<unsigned char>(pattern[j])) )
+			++j;
+		
+		if( j == pattern.size() || pattern[j] != 'd' )
+			return false;
+		
+		++conversions;
+		i = j;
+	}
+	
+	return conversions == 1 && pattern.size() < 4000;
+}
+
+bool renderSequence(CompiledScene& scene, RenderPool& pool, const SequenceSettings& settings){
+	assert(settings.frameCount > 0 && isValidFramePattern(settings.outputPattern));
+	
+	// Frames are traced into one buffer while the previous one is being written from the other
+	ImageRGBAF buffers[2];
+	buffers[0].assign(settings.width, settings.height);
+	buffers[1].assign(settings.width, settings.height);
+	
+	std::vector<Tile> tiles;
+	generateTilesOfSize(tiles, settings.width, settings.height);
+	
+	const float aspect = float(settings.width) / float(settings.height);
+	const float start = scene.startTime();
+	const float step = settings.frameCount > 1 ? (scene.endTime() - start) / float(settings.frameCount - 1) : 0.f;
+	
+	FrameWriter writer;
+	const auto sequenceStart = std::chrono::steady_clock::now();
+	
+	for(size_t frame=0; frame < settings.frameCount; ++frame){
+		const auto frameStart = std::chrono::steady_clock::now();
+		const Camera camera = scene.setTime(start + step * frame, pool).makeCamera(aspect);
+		const double msUpdate = millisecondsSince(frameStart);
+		ImageRGBAF& buffer = buffers[frame % 2];
+		const TileKernel kernel = selectKernel(kernelConfigFor(scene, camera, settings.sampleCount, MAX_DEPTH));
+		
+		pool.submit(tiles, [&](const Tile& tile){
+			kernel(buffer, scene, camera, tile, settings.sampleCount, MAX_DEPTH);
+		})->wait();
+		
+		const double msTrace = millisecondsSince(frameStart) - msUpdate;
+		writer.write(buffer, framePath(settings.outputPattern, frame));
+		
+		printf("frame %zu: %.1fms update, %.1fms trace, %.1fms total\n",
+			   frame, msUpdate, msTrace, millisecondsSince(frameStart));
+	}
+	
+	const bool success = writer.finish();
+	printf("%zu frames in %.0fms\n", settings.frameCount, millisecondsSince(sequenceStart));
+	return success;
+}
@@ -0,0 +1,22 @@
+#ifndef sequence_h
+#define sequence_h
+
+#include <string>
+
+class CompiledScene;
+class RenderPool;
+
+struct SequenceSettings {
+	std::string outputPattern; // printf pattern taking the frame number, e.g. "frames/%04d.ppm"
+	size_t frameCount;
+	size_t width, height;
+	size_t sampleCount;
+};
+
+bool isValidFramePattern(const std::string& pattern);
+
+// Renders frameCount frames spread evenly over the keyframes of the scene. Moving objects only get
+// their BVH refitted between frames, and each frame is written out while the next one is traced.
+bool renderSequence(CompiledScene& scene, RenderPool& pool, const SequenceSettings& settings);
+
+#endif /* sequence_h */
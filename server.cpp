@@ -0,0 +1,243 @@
+
+#include "./server.hpp"
+#include "./pool.hpp"
+#include "./cache.hpp"
+#include "./net.hpp"
+#include "./image.hpp"
+
+#include <thread>
+#include <sstream>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+	constexpr size_t MAX_LINE_LENGTH = 4096;
+	constexpr size_t MAX_PIXELS = 8192 * 8192;
+	constexpr size_t MAX_SAMPLES = 1 << 16;
+	
+	bool parseSize(const std::string& value, size_t& out){
+		char *end = nullptr;
+		const unsigned long parsed = strtoul(value.c_str(), &end, 10);
+		
+		if( value.empty() || *end != '\0' || parsed == 0 )
+			return false;
+		
+		out = parsed;
+		return true;
+	}
+	
+	bool parseFloat(const std::string& value, float& out){
+		char *end = nullptr;
+		out = strtof(value.c_str(), &end);
+		return !value.empty() && *end == '\0' && std::isfinite(out);
+	}
+	
+	bool parseVector(const std::string& value, Vector3f& out){
+		const size_t first = value.find(',');
+		const size_t second = first == std::string::npos ? first : value.find(',', first + 1);
+		
+		return second != std::string::npos &&
+			   parseFloat(value.substr(0, first), out.x) &&
+			   parseFloat(value.substr(first + 1, second - first - 1), out.y) &&
+			   parseFloat(value.substr(second + 1), out.z);
+	}
+	
+	bool readLine(int fd, std::string& line){
+		line.clear();
+		
+		for(char c; line.size() < MAX_LINE_LENGTH;){
+			if( !recvAll(fd, &c, 1) )
+				return false;
+			
+			if( c == '\n' )
+				return true;
+			
+			if( c != '\r' )
+				line.push_back(c);
+		}
+		
+		return false;
+	}
+	
+	bool sendError(int fd, const std::string& error){
+		const std::string line = "error: " + error + "\n";
+		return sendAll(fd, line.data(), line.size());
+	}
+	
+	// Replaces the id of a scene description with its real path, which must be inside directory.
+	// Clients name any file they like, and loading a scene also writes its compiled cache next to it.
+	bool resolveSceneId(std::string& id, const std::string& directory, std::string& error){
+		if( isBuiltinScene(id) )
+			return true;
+		
+		error = "unknown scene '" + id + "'";
+		
+		if( directory.empty() || id[0] == '/' )
+			return false;
+		
+		// Resolving symbolic links and .. first, so that the path checked is the one loaded
+		char resolved[PATH_MAX];
+		const std::string prefix = directory.back() == '/' ? directory : directory + "/";
+		
+		if( realpath((prefix + id).c_str(), resolved) == nullptr || strncmp(resolved, prefix.c_str(), prefix.size()) != 0 )
+			return false;
+		
+		id = resolved;
+		return true;
+	}
+	
+	void render(RenderPool& pool, const Scene& scene, const RenderJob& job, ImageRGBAUNorm& image){
+		ImageRGBAF buffer(job.width, job.height);
+		image.assign(job.width, job.height);
+		
+		const Camera camera = job.cameraFor(scene).makeCamera(float(job.width) / float(job.height));
+		const Hittable& world = *scene.world;
+		const int maxDepth = int(job.maxDepth);
+		const TileKernel kernel = selectKernel(kernelConfigFor(world, camera, job.sampleCount, maxDepth));
+		
+		std::vector<Tile> tiles;
+		generateTilesOfSize(tiles, job.width, job.height);
+		
+		pool.submit(std::move(tiles), [&](const Tile& tile){
+			kernel(buffer, world, camera, tile, job.sampleCount, maxDepth);
+			resolveTile(image, buffer, tile);
+		})->wait();
+	}
+	
+	void serve(int fd, RenderPool& pool, SceneCache& cache, const std::string& sceneDirectory){
+		std::string line, error;
+		std::vector<uint8_t> encoded;
+		
+		while( readLine(fd, line) ){
+			if( line.empty() )
+				continue;
+			
+			RenderJob job;
+			
+			if( !parseRenderJob(line, job, error) || !resolveSceneId(job.scene, sceneDirectory, error) ){
+				if( !sendError(fd, error) )
+					break;
+				
+				continue;
+			}
+			
+			// Hold on to the scene for the whole render, even if it gets evicted meanwhile
+			std::shared_ptr<Scene> scene = cache.acquire(job.scene);
+			
+			if( scene == nullptr ){
+				if( !sendError(fd, "unknown scene '" + job.scene + "'") )
+					break;
+				
+				continue;
+			}
+			
+			ImageRGBAUNorm image;
+			render(pool, *scene, job, image);
+			encodePPM(image, encoded);
+			
+			if( !sendAll(fd, encoded.data(), encoded.size()) )
+				break;
+		}
+		
+		closeSocket(fd);
+	}
+}
+
+CameraSettings RenderJob::cameraFor(const Scene& scene) const {
+	CameraSettings result = scene.camera;
+	
+	if( cameraFields & LookFrom ) result.lookFrom = camera.lookFrom;
+	if( cameraFields & LookAt ) result.lookAt = camera.lookAt;
+	if( cameraFields & Up ) result.up = camera.up;
+	if( cameraFields & Fov ) result.degVerticalFov = camera.degVerticalFov;
+	if( cameraFields & Aperture ) result.aperture = camera.aperture;
+	if( cameraFields & Focus ) result.focusDistance = camera.focusDistance;
+	
+	return result;
+}
+
+bool parseRenderJob(const std::string& line, RenderJob& job, std::string& error){
+	std::istringstream tokens(line);
+	std::string token;
+	
+	while( tokens >> token ){
+		const size_t equal = token.find('=');
+		const std::string key = token.substr(0, equal);
+		const std::string value = equal == std::string::npos ? "" : token.substr(equal + 1);
+		bool valid = true;
+		
+		if( key == "scene" ){
+			job.scene = value;
+			valid = !value.empty();
+		} else if( key == "width" ){
+			valid = parseSize(value, job.width);
+		} else if( key == "height" ){
+			valid = parseSize(value, job.height);
+		} else if( key == "samples" ){
+			valid = parseSize(value, job.sampleCount) && job.sampleCount <= MAX_SAMPLES;
+		} else if( key == "depth" ){
+			valid = parseSize(value, job.maxDepth) && job.maxDepth <= MAX_DEPTH;
+		} else if( key == "from" ){
+			valid = parseVector(value, job.camera.lookFrom);
+			job.cameraFields |= RenderJob::LookFrom;
+		} else if( key == "at" ){
+			valid = parseVector(value, job.camera.lookAt);
+			job.cameraFields |= RenderJob::LookAt;
+		} else if( key == "up" ){
+			valid = parseVector(value, job.camera.up);
+			job.cameraFields |= RenderJob::Up;
+		} else if( key == "fov" ){
+			valid = parseFloat(value, job.camera.degVerticalFov);
+			job.cameraFields |= RenderJob::Fov;
+		} else if( key == "aperture" ){
+			valid = parseFloat(value, job.camera.aperture);
+			job.cameraFields |= RenderJob::Aperture;
+		} else if( key == "focus" ){
+			valid = parseFloat(value, job.camera.focusDistance);
+			job.cameraFields |= RenderJob::Focus;
+		} else {
+			error = "unknown key '" + key + "'";
+			return false;
+		}
+		
+		if( !valid ){
+			error = "invalid value for '" + key + "'";
+			return false;
+		}
+	}
+	
+	if( job.scene.empty() ){
+		error = "missing scene";
+		return false;
+	}
+	
+	if( job.width > MAX_PIXELS || job.height > MAX_PIXELS || job.width * job.height > MAX_PIXELS ){
+		error = "image too large";
+		return false;
+	}
+	
+	return true;
+}
+
+bool runServer(const std::string& address, RenderPool& pool, SceneCache& cache, const std::string& sceneDirectory){
+	char resolved[PATH_MAX];
+	
+	if( !sceneDirectory.empty() && realpath(sceneDirectory.c_str(), resolved) == nullptr ){
+		perror(sceneDirectory.c_str());
+		return false;
+	}
+	
+	const std::string directory = sceneDirectory.empty() ? "" : resolved;
+	const int listenFd = listenOn(address);
+	if( listenFd < 0 )
+		return false;
+	
+	while(true){
+		const int fd = acceptFrom(listenFd);
+		
+		if( fd >= 0 )
+			std::thread(serve, fd, std::ref(pool), std::ref(cache), directory).detach();
+	}
+}
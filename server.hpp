@@ -0,0 +1,43 @@
+#ifndef server_h
+#define server_h
+
+#include "./scene.hpp"
+#include "./render.hpp"
+
+#include <string>
+
+class RenderPool;
+class SceneCache;
+
+// A render request, sent to the server as a single line of key=value pairs separated by spaces:
+//   scene=default width=640 height=360 samples=16 depth=8 from=13,2,3 at=0,0,0 up=0,1,0 fov=20 aperture=0.1 focus=10
+// Only scene is required, the camera defaults to the scene's own and depth to the usual limit.
+// Previews with depth=8 and aperture=0 get the cheapest kernel.
+struct RenderJob {
+	std::string scene;
+	size_t width = 640, height = 360;
+	size_t sampleCount = 16;
+	size_t maxDepth = MAX_DEPTH;
+	
+	// Camera fields given by the request, replacing those of the scene's camera
+	enum CameraField: unsigned {
+		LookFrom = 1 << 0, LookAt = 1 << 1, Up = 1 << 2,
+		Fov = 1 << 3, Aperture = 1 << 4, Focus = 1 << 5,
+	};
+	
+	CameraSettings camera;
+	unsigned cameraFields = 0;
+	
+	CameraSettings cameraFor(const Scene& scene) const;
+};
+
+bool parseRenderJob(const std::string& line, RenderJob& job, std::string& error);
+
+// Serves render jobs on address forever. Every connection may send any number of jobs, each one
+// answered with the image as a binary PPM or with a line starting with "error:".
+// Jobs from all connections share the pool's threads and the cached scenes.
+// Besides the built-in scenes, jobs may only name scene descriptions inside sceneDirectory, by their
+// path relative to it, and none at all when it is empty.
+bool runServer(const std::string& address, RenderPool& pool, SceneCache& cache, const std::string& sceneDirectory);
+
+#endif /* server_h */
@@ -0,0 +1,466 @@
+
+#include "./texture.hpp"
+#include "./image.hpp"
+#include "./compiled.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+#include <type_traits>
+
+namespace {
+	const char MAGIC[8] = {'R', 'T', 'M', 'I', 'P', 0, 0, 0};
+	constexpr uint32_t VERSION = 1;
+	constexpr uint32_t MAX_LEVELS = 32;
+	
+	// A tile of 8 bit RGBA texels fills a 16KiB page, so single tiles can be dropped from the mapping
+	constexpr uint32_t TILE_SIZE = 64;
+	constexpr size_t TILE_BYTES = TILE_SIZE * TILE_SIZE * sizeof(PixelRGBAUNorm);
+	
+	constexpr size_t DEFAULT_BUDGET = size_t(256) << 20;
+	
+	// Tile states for the clock sweep
+	enum: uint8_t { EVICTED, REFERENCED, RESIDENT };
+	
+	struct LevelHeader {
+		uint32_t width, height;
+		uint32_t tilesX, tilesY;
+		uint64_t offset;
+	};
+	
+	struct FileHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t byteOrder;
+		uint32_t tileSize, levelCount;
+		SourceStamp source;
+		LevelHeader levels[MAX_LEVELS];
+	};
+	
+	static_assert(std::is_trivially_copyable<FileHeader>::value, "mip pyramids are saved as raw bytes");
+	static_assert(sizeof(FileHeader) <= TILE_BYTES, "the header fits before the first tile");
+	
+	// Texels are stored gamma encoded like the images they come from, but filtered in linear space
+	float toLinear(uint8_t value){
+		const float v = value / 255.f;
+		return v * v;
+	}
+	
+	uint8_t toGamma(float value){
+		return static_cast<uint8_t>(sqrt(clamp(value, 0.f, 1.f)) * 255.f + .5f);
+	}
+	
+	uint32_t wrap(int64_t value, uint32_t size){
+		const int64_t wrapped = value % int64_t(size);
+		return static_cast<uint32_t>(wrapped < 0 ? wrapped + size : wrapped);
+	}
+	
+	// Receives the rows of one level of the pyramid from the top down, as they are read from the image,
+	// writes its tiles one band of tile rows at a time and hands the box filtered rows on to the next level.
+	// Building a pyramid so needs memory for a few rows of every level rather than for the whole image.
+	class LevelWriter {
+	public:
+		LevelWriter(const LevelHeader& level, FILE *file, LevelWriter *next)
+		: level_(level), file_(file), next_(next), band_(size_t(level.tilesX) * TILE_SIZE * TILE_SIZE) {
+			if( next_ != nullptr ){
+				pending_.resize(level.width);
+				half_.resize(next_->level_.width);
+			}
+		}
+		
+		bool addRow(uint32_t y, const Vector3f *row){
+			assert(y < level_.height);
+			
+			// Edge tiles are padded by repeating the last row and column
+			const uint32_t last = y == level_.height - 1 ? TILE_SIZE - 1 : y % TILE_SIZE;
+			
+			for(uint32_t ty=y % TILE_SIZE; ty <= last; ++ty){
+				for(uint32_t x=0; x < level_.tilesX * TILE_SIZE; ++x){
+					const Vector3f& t = row[std::min(x, level_.width - 1)];
+					band_[(x / TILE_SIZE) * TILE_SIZE * TILE_SIZE + ty * TILE_SIZE + x % TILE_SIZE] = {toGamma(t.x), toGamma(t.y), toGamma(t.z), 255};
+				}
+			}
+			
+			if( y % TILE_SIZE == 0 && !writeBand(y / TILE_SIZE) )
+				return false;
+			
+			if( next_ == nullptr )
+				return true;
+			
+			// Rows 2k and 2k + 1 make row k of the next level, the lower one arriving last
+			if( y % 2 == 1 ){
+				std::copy_n(row, level_.width, pending_.begin());
+				return true;
+			}
+			
+			const Vector3f *above = y + 1 < level_.height ? pending_.data() : row;
+			
+			for(uint32_t x=0; x < next_->level_.width; ++x){
+				const uint32_t x0 = std::min(2 * x, level_.width - 1), x1 = std::min(2 * x + 1, level_.width - 1);
+				half_[x] = .25f * (row[x0] + row[x1] + above[x0] + above[x1]);
+			}
+			
+			return next_->addRow(y / 2, half_.data());
+		}
+		
+	private:
+		bool writeBand(uint32_t ty){
+			const uint64_t offset = level_.offset + uint64_t(ty) * level_.tilesX * TILE_BYTES;
+			return fseeko(file_, off_t(offset), SEEK_SET) == 0 &&
+				   fwrite(band_.data(), sizeof(PixelRGBAUNorm), band_.size(), file_) == band_.size();
+		}
+		
+		LevelHeader level_;
+		FILE *file_;
+		LevelWriter *next_;
+		std::vector<PixelRGBAUNorm> band_; // the tiles of the band being filled, one after the other
+		std::vector<Vector3f> pending_;    // the upper row of the pair the next level is waiting for
+		std::vector<Vector3f> half_;
+	};
+	
+	// Converts the image into a tiled mip pyramid file, written next to path and moved in place
+	bool buildPyramid(const std::string& imagePath, const std::string& path, const SourceStamp& source){
+		FILE *image = fopen(imagePath.c_str(), "rb");
+		if( image == nullptr )
+			return false;
+		
+		size_t imageWidth = 0, imageHeight = 0;
+		
+		// Level sizes are stored in 32 bits
+		if( !readPPMHeader(image, imageWidth, imageHeight) || imageWidth > (1u << 31) || imageHeight > (1u << 31) ){
+			fclose(image);
+			return false;
+		}
+		
+		FileHeader header;
+		memset(static_cast<void*>(&header), 0, sizeof(header));
+		memcpy(header.magic, MAGIC, sizeof(MAGIC));
+		header.version = VERSION;
+		header.byteOrder = 0x01020304;
+		header.tileSize = TILE_SIZE;
+		header.source = source;
+		
+		uint64_t offset = TILE_BYTES;
+		
+		for(uint32_t width=uint32_t(imageWidth), height=uint32_t(imageHeight);; width=std::max(1u, (width + 1) / 2), height=std::max(1u, (height + 1) / 2)){
+			LevelHeader& level = header.levels[header.levelCount++];
+			level = {width, height, (width + TILE_SIZE - 1) / TILE_SIZE, (height + TILE_SIZE - 1) / TILE_SIZE, offset};
+			offset += uint64_t(level.tilesX) * level.tilesY * TILE_BYTES;
+			
+			if( (width == 1 && height == 1) || header.levelCount == MAX_LEVELS )
+				break;
+		}
+		
+		const std::string temporaryPath = path + ".tmp" + std::to_string(getpid());
+		FILE *file = fopen(temporaryPath.c_str(), "wb");
+		if( file == nullptr ){
+			fclose(image);
+			return false;
+		}
+		
+		std::vector<uint8_t> headerPage(TILE_BYTES, 0);
+		memcpy(headerPage.data(), &header, sizeof(header));
+		bool success = fwrite(headerPage.data(), 1, headerPage.size(), file) == headerPage.size();
+		
+		// Built from the smallest level up so that each one can point at the next
+		std::vector<std::unique_ptr<LevelWriter>> levels(header.levelCount);
+		for(uint32_t l=header.levelCount; l-- > 0;)
+			levels[l].reset(new LevelWriter(header.levels[l], file, l + 1 < header.levelCount ? levels[l + 1].get() : nullptr));
+		
+		std::vector<uint8_t> bytes(3 * imageWidth);
+		std::vector<Vector3f> row(imageWidth);
+		
+		// The image is stored top down, while the rows of the pyramid start at the bottom
+		for(size_t y=imageHeight; y-- > 0 && success;){
+			success = fread(bytes.data(), 1, bytes.size(), image) == bytes.size();
+			
+			for(size_t x=0; x < imageWidth; ++x)
+				row[x] = {toLinear(bytes[3 * x + 0]), toLinear(bytes[3 * x + 1]), toLinear(bytes[3 * x + 2])};
+			
+			success = success && levels[0]->addRow(uint32_t(y), row.data());
+		}
+		
+		fclose(image);
+		success = (fclose(file) == 0) && success && rename(temporaryPath.c_str(), path.c_str()) == 0;
+		
+		if( !success )
+			unlink(temporaryPath.c_str());
+		
+		return success;
+	}
+}
+
+// MARK: - CheckerTexture
+Vector3f CheckerTexture::sample(Vector2f uv, float footprint) const {
+	const int64_t checkX = static_cast<int64_t>(std::floor(uv.x * frequency));
+	const int64_t checkY = static_cast<int64_t>(std::floor(uv.y * frequency));
+	const Vector3f& color = ((checkX + checkY) & 1) == 0 ? even : odd;
+	
+	// Past half a check per pixel the pattern would alias, fade it into its average instead
+	const float blur = clamp(2.f * footprint * frequency - 1.f, 0.f, 1.f);
+	return lerp(blur, color, .5f * (even + odd));
+}
+
+// MARK: - ImageTexture
+ImageTexture::ImageTexture(TextureCache& cache, const uint8_t *mapping, size_t mappingSize, std::vector<Level> levels)
+: cache_(cache), mapping_(mapping), mappingSize_(mappingSize), levels_(std::move(levels)) {
+	const Level& last = levels_.back();
+	tileCount_ = last.firstTile + last.tilesX * last.tilesY;
+	tileStates_.reset(new std::atomic<uint8_t>[tileCount_]);
+	
+	for(uint32_t i=0; i < tileCount_; ++i)
+		tileStates_[i].store(EVICTED, std::memory_order_relaxed);
+}
+
+ImageTexture::~ImageTexture(){
+	cache_.remove(this);
+	munmap(const_cast<uint8_t*>(mapping_), mappingSize_);
+}
+
+Vector3f ImageTexture::sample(Vector2f uv, float footprint) const {
+	const float texels = footprint * float(std::max(width(), height()));
+	const float lod = texels > 1.f ? std::min(std::log2(texels), float(levels_.size() - 1)) : 0.f;
+	const size_t level = static_cast<size_t>(lod);
+	const float t = lod - float(level);
+	
+	const Vector3f fine = bilinear(levels_[level], uv);
+	if( t == 0.f )
+		return fine;
+	
+	return lerp(t, fine, bilinear(levels_[level + 1], uv));
+}
+
+Vector3f ImageTexture::bilinear(const Level& level, Vector2f uv) const {
+	const float x = uv.x * level.width - .5f;
+	const float y = uv.y * level.height - .5f;
+	const float fx = std::floor(x), fy = std::floor(y);
+	const float tx = x - fx, ty = y - fy;
+	
+	const uint32_t x0 = wrap(int64_t(fx), level.width), x1 = wrap(int64_t(fx) + 1, level.width);
+	const uint32_t y0 = wrap(int64_t(fy), level.height), y1 = wrap(int64_t(fy) + 1, level.height);
+	
+	return lerp(ty,
+				lerp(tx, texel(level, x0, y0), texel(level, x1, y0)),
+				lerp(tx, texel(level, x0, y1), texel(level, x1, y1)));
+}
+
+Vector3f ImageTexture::texel(const Level& level, uint32_t x, uint32_t y) const {
+	const uint32_t tile = (y / TILE_SIZE) * level.tilesX + x / TILE_SIZE;
+	touch(level.firstTile + tile);
+	
+	const PixelRGBAUNorm *tileTexels = reinterpret_cast<const PixelRGBAUNorm*>(mapping_ + level.offset + tile * TILE_BYTES);
+	const PixelRGBAUNorm& p = tileTexels[(y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE];
+	return {toLinear(p.r), toLinear(p.g), toLinear(p.b)};
+}
+
+const uint8_t* ImageTexture::tileAddress(uint32_t tile) const {
+	size_t level = levels_.size() - 1;
+	while( levels_[level].firstTile > tile )
+		--level;
+	
+	return mapping_ + levels_[level].offset + size_t(tile - levels_[level].firstTile) * TILE_BYTES;
+}
+
+void ImageTexture::touch(uint32_t tile) const {
+	std::atomic<uint8_t>& state = tileStates_[tile];
+	
+	if( state.load(std::memory_order_relaxed) == REFERENCED )
+		return;
+	
+	if( state.exchange(REFERENCED, std::memory_order_relaxed) == EVICTED )
+		cache_.added(TILE_BYTES);
+}
+
+// MARK: - TextureCache
+TextureCache& TextureCache::shared(){
+	static TextureCache cache(DEFAULT_BUDGET);
+	return cache;
+}
+
+std::shared_ptr<ImageTexture> TextureCache::load(const std::string& path){
+	std::unique_lock<std::mutex> lk(loadLock_);
+	Entry& entry = loaded_[path];
+	
+	std::shared_ptr<ImageTexture> texture = entry.texture.lock();
+	if( texture != nullptr )
+		return texture;
+	
+	if( entry.loading.valid() ){
+		std::shared_future<std::shared_ptr<ImageTexture>> loading = entry.loading;
+		lk.unlock();
+		return loading.get();
+	}
+	
+	// Build and map outside of the lock so that loads of other images are not held up
+	std::promise<std::shared_ptr<ImageTexture>> promise;
+	entry.loading = promise.get_future().share();
+	lk.unlock();
+	
+	texture = openPyramid(path);
+	promise.set_value(texture);
+	
+	// Waiters hold their own copy of the future, the entry only keeps the texture weakly
+	lk.lock();
+	entry.texture = texture;
+	entry.loading = {};
+	return texture;
+}
+
+std::shared_ptr<ImageTexture> TextureCache::openPyramid(const std::string& path){
+	SourceStamp source;
+	if( !SourceStamp::of(path, source) )
+		return nullptr;
+	
+	const std::string mipPath = path + ".mip";
+	
+	// Maps the pyramid if it was built from this version of the image
+	const auto map = [&]() -> std::shared_ptr<ImageTexture> {
+		const int fd = open(mipPath.c_str(), O_RDONLY);
+		if( fd < 0 )
+			return nullptr;
+		
+		struct stat info;
+		void *mapping = MAP_FAILED;
+		size_t size = 0;
+		
+		if( fstat(fd, &info) == 0 && size_t(info.st_size) >= TILE_BYTES ){
+			size = size_t(info.st_size);
+			mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		}
+		
+		close(fd);
+		
+		if( mapping == MAP_FAILED )
+			return nullptr;
+		
+		// Sampling jumps around, reading ahead of the tiles we touch would only waste the budget
+		madvise(mapping, size, MADV_RANDOM);
+		
+		FileHeader header;
+		memcpy(&header, mapping, sizeof(header));
+		
+		bool valid =
+			memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+			header.version == VERSION &&
+			header.byteOrder == 0x01020304 &&
+			header.tileSize == TILE_SIZE &&
+			header.source == source &&
+			header.levelCount > 0 && header.levelCount <= MAX_LEVELS;
+		
+		std::vector<ImageTexture::Level> levels;
+		uint32_t firstTile = 0;
+		
+		for(uint32_t i=0; valid && i < header.levelCount; ++i){
+			const LevelHeader& level = header.levels[i];
+			const uint64_t tiles = uint64_t(level.tilesX) * level.tilesY;
+			
+			valid = level.width > 0 && level.height > 0 &&
+					level.tilesX == (level.width + TILE_SIZE - 1) / TILE_SIZE &&
+					level.tilesY == (level.height + TILE_SIZE - 1) / TILE_SIZE &&
+					level.offset % TILE_BYTES == 0 && level.offset <= size && tiles <= (size - level.offset) / TILE_BYTES;
+			
+			levels.push_back({level.width, level.height, level.tilesX, level.tilesY, level.offset, firstTile});
+			firstTile += static_cast<uint32_t>(tiles);
+		}
+		
+		if( !valid ){
+			munmap(mapping, size);
+			return nullptr;
+		}
+		
+		std::shared_ptr<ImageTexture> texture(new ImageTexture(*this, static_cast<const uint8_t*>(mapping), size, std::move(levels)));
+		
+		std::lock_guard<std::mutex> lg(lock_);
+		textures_.push_back(texture.get());
+		return texture;
+	};
+	
+	std::shared_ptr<ImageTexture> texture = map();
+	
+	if( texture == nullptr ){
+		if( !buildPyramid(path, mipPath, source) ){
+			fprintf(stderr, "could not build the mip pyramid of '%s'\n", path.c_str());
+			return nullptr;
+		}
+		
+		texture = map();
+	}
+	
+	return texture;
+}
+
+void TextureCache::added(size_t bytes){
+	if( resident_.fetch_add(bytes, std::memory_order_relaxed) + bytes > budget_.load(std::memory_order_relaxed) )
+		evict();
+}
+
+void TextureCache::remove(ImageTexture *texture){
+	std::lock_guard<std::mutex> lg(lock_);
+	
+	for(uint32_t i=0; i < texture->tileCount_; ++i){
+		if( texture->tileStates_[i].load(std::memory_order_relaxed) != EVICTED )
+			resident_ -= TILE_BYTES;
+	}
+	
+	const auto position = std::find(textures_.begin(), textures_.end(), texture);
+	const size_t index = position - textures_.begin();
+	
+	// Keeps the hand on the texture it was sweeping, or moves it to the start of the one that follows
+	if( index < handTexture_ )
+		--handTexture_;
+	else if( index == handTexture_ )
+		handTile_ = 0;
+	
+	textures_.erase(position);
+}
+
+void TextureCache::evict(){
+	// One thread sweeps while the others keep rendering
+	std::unique_lock<std::mutex> lk(lock_, std::try_to_lock);
+	if( !lk.owns_lock() )
+		return;
+	
+	// Sweeps down to below the budget so every new tile does not start a sweep
+	const size_t target = budget_ / 8 * 7;
+	size_t totalTiles = 0;
+	
+	for(const ImageTexture *texture: textures_)
+		totalTiles += texture->tileCount_;
+	
+	// Two turns at most, the first one may only clear the referenced bits
+	for(size_t step=0; step < 2 * totalTiles && resident_ > target; ++step){
+		if( handTexture_ >= textures_.size() ){
+			handTexture_ = 0;
+			handTile_ = 0;
+		}
+		
+		const ImageTexture *texture = textures_[handTexture_];
+		if( handTile_ >= texture->tileCount_ ){
+			++handTexture_;
+			handTile_ = 0;
+			continue;
+		}
+		
+		std::atomic<uint8_t>& state = texture->tileStates_[handTile_];
+		uint8_t expected = REFERENCED;
+		
+		if( !state.compare_exchange_strong(expected, RESIDENT, std::memory_order_relaxed) && expected == RESIDENT &&
+			state.compare_exchange_strong(expected, EVICTED, std::memory_order_relaxed) ){
+			// A thread still reading the tile only faults it back in from the file
+			madvise(const_cast<uint8_t*>(texture->tileAddress(handTile_)), TILE_BYTES, MADV_DONTNEED);
+			resident_ -= TILE_BYTES;
+		}
+		
+		if( ++handTile_ == texture->tileCount_ ){
+			++handTexture_;
+			handTile_ = 0;
+		}
+	}
+}
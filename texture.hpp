@@ -0,0 +1,124 @@
+#ifndef texture_h
+#define texture_h
+
+#include "./math.hpp"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <future>
+#include <mutex>
+
+class TextureCache;
+
+struct Texture {
+	virtual ~Texture(){}
+	
+	// footprint is the width in texture coordinates of the area seen through the pixel, which the
+	// texture is filtered over
+	virtual Vector3f sample(Vector2f uv, float footprint) const =0;
+};
+
+struct CheckerTexture: public Texture {
+	Vector3f even, odd;
+	float frequency; // checks per unit of texture coordinates
+	
+	CheckerTexture(const Vector3f& e, const Vector3f& o, float f): even(e), odd(o), frequency(f) {}
+	
+	Vector3f sample(Vector2f uv, float footprint) const override;
+};
+
+// An image stored as a mip pyramid of square tiles in a file mapped into memory. Tiles are only read
+// from disk when first sampled, and dropped again when the cache that loaded the texture goes over budget.
+class ImageTexture: public Texture {
+public:
+	~ImageTexture();
+	
+	ImageTexture(const ImageTexture&) = delete;
+	ImageTexture& operator=(const ImageTexture&) = delete;
+	
+	// Trilinear filtering between the two levels closest to the footprint, wrapping around at the edges
+	Vector3f sample(Vector2f uv, float footprint) const override;
+	
+	size_t width() const noexcept { return levels_[0].width; }
+	size_t height() const noexcept { return levels_[0].height; }
+	size_t levelCount() const noexcept { return levels_.size(); }
+
+private:
+	friend class TextureCache;
+	
+	struct Level {
+		uint32_t width, height;
+		uint32_t tilesX, tilesY;
+		uint64_t offset;
+		uint32_t firstTile;
+	};
+	
+	ImageTexture(TextureCache& cache, const uint8_t *mapping, size_t mappingSize, std::vector<Level> levels);
+	
+	Vector3f bilinear(const Level& level, Vector2f uv) const;
+	Vector3f texel(const Level& level, uint32_t x, uint32_t y) const;
+	
+	const uint8_t* tileAddress(uint32_t tile) const;
+	
+	// Makes the tile count as resident and recently used
+	void touch(uint32_t tile) const;
+	
+	TextureCache& cache_;
+	const uint8_t *mapping_;
+	size_t mappingSize_;
+	std::vector<Level> levels_;
+	uint32_t tileCount_;
+	std::unique_ptr<std::atomic<uint8_t>[]> tileStates_;
+};
+
+// Loads image textures and bounds the memory their tiles use. Eviction is a clock sweep, an approximation of
+// least recently used that costs sampling no more than one relaxed atomic load per tile read.
+class TextureCache {
+public:
+	explicit TextureCache(size_t memoryBudget): budget_(memoryBudget) {}
+	
+	TextureCache(const TextureCache&) = delete;
+	TextureCache& operator=(const TextureCache&) = delete;
+	
+	// The cache scene materials load their textures from
+	static TextureCache& shared();
+	
+	void setMemoryBudget(size_t bytes) noexcept { budget_ = bytes; }
+	size_t memoryUsage() const noexcept { return resident_; }
+	
+	// Maps the mip pyramid of the PPM image at path, path + ".mip", building it first when it is missing
+	// or out of date. Textures still in use are shared, and concurrent loads of the same image wait for the
+	// one building it. Returns nullptr if the image cannot be read.
+	std::shared_ptr<ImageTexture> load(const std::string& path);
+
+private:
+	friend class ImageTexture;
+	
+	struct Entry {
+		std::shared_future<std::shared_ptr<ImageTexture>> loading; // only valid while the texture is being loaded
+		std::weak_ptr<ImageTexture> texture;
+	};
+	
+	// Maps the pyramid, building it first if need be, without touching loaded_
+	std::shared_ptr<ImageTexture> openPyramid(const std::string& path);
+	
+	void added(size_t bytes);
+	void remove(ImageTexture *texture);
+	void evict();
+	
+	std::atomic<size_t> budget_;
+	std::atomic<size_t> resident_{0};
+	
+	std::vector<ImageTexture*> textures_;
+	size_t handTexture_ = 0; // where the clock sweep continues from
+	uint32_t handTile_ = 0;
+	std::mutex lock_;
+	
+	std::unordered_map<std::string, Entry> loaded_;
+	std::mutex loadLock_;
+};
+
+#endif /* texture_h */
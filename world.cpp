@@ -1,5 +1,7 @@
 
 #include "./world.hpp"
+#include "./material.hpp"
+#include "./instrument.hpp"
 
 #include <cassert>
 
@@ -13,6 +15,17 @@ void World::clear(){
 		delete curr;
 	
 	objects_.clear();
+	bvh_.clear();
+}
+
+void World::build(){
+	std::vector<AABBf> objectBounds;
+	objectBounds.reserve(objects_.size());
+	
+	for(const Hittable *curr: objects_)
+		objectBounds.push_back(curr->bounds());
+	
+	bvh_.build(objectBounds);
 }
 
 bool World::hit(const Rayf& r, float tMin, float tMax, Hit& hit) const {
@@ -20,7 +33,26 @@ bool World::hit(const Rayf& r, float tMin, float tMax, Hit& hit) const {
 	bool didHit = false;
 	float minDistance = tMax;
 	
-	for(const Hittable *curr: objects_){
+	const auto hitObject = [&](uint32_t index, float tMin, float tMax){
+		if( objects_[index]->hit(r, tMin, tMax, lastHit) ){
+			hit = lastHit;
+			return lastHit.t;
+		}
+		
+		return tMax;
+	};
+	
+	const size_t indexed = bvh_.indexCount();
+	
+	if( bvh_.hit(r, tMin, minDistance, hitObject) ){
+		didHit = true;
+		minDistance = hit.t;
+	}
+	
+	for(size_t i=indexed; i < objects_.size(); ++i){
+		const Hittable *curr = objects_[i];
+		RT_COUNT(primitiveTests);
+		
 		if( curr->hit(r, tMin, minDistance, lastHit) ){
 			didHit = true;
 			minDistance = lastHit.t;
@@ -30,3 +62,36 @@ bool World::hit(const Rayf& r, float tMin, float tMax, Hit& hit) const {
 	
 	return didHit;
 }
+
+bool World::textured() const {
+	for(const Hittable *curr: objects_){
+		if( curr->textured() )
+			return true;
+	}
+	
+	return false;
+}
+
+bool World::diffuseOnly() const {
+	for(const Hittable *curr: objects_){
+		if( !curr->diffuseOnly() )
+			return false;
+	}
+	
+	return true;
+}
+
+AABBf World::bounds() const {
+	AABBf result = AABBf::empty();
+	
+	for(const Hittable *curr: objects_)
+		result.extend(curr->bounds());
+	
+	return result;
+}
+
+size_t World::memoryUsage() const {
+	return sizeof(World) + objects_.capacity() * sizeof(Hittable*) +
+		   objects_.size() * (sizeof(Sphere) + sizeof(MetalMaterial)) +
+		   bvh_.memoryUsage();
+}
@@ -2,6 +2,7 @@
 #define world_h
 
 #include "./hittable.hpp"
+#include "./bvh.hpp"
 
 #include <vector>
 #include <cassert>
@@ -17,10 +18,20 @@ public:
 	void add(Hittable *h);
 	void clear();
 	
+	// Builds the acceleration structure, objects added afterwards are tested linearly until the next build
+	void build();
+	
 	bool hit(const Rayf& r, float tMin, float tMax, Hit& hit) const override;
+	AABBf bounds() const override;
+	bool textured() const override;
+	bool diffuseOnly() const override;
+	
+	// Estimate assuming every object is a sphere
+	size_t memoryUsage() const;
 	
 private:
 	std::vector<Hittable*> objects_;
+	BVH bvh_;
 };
 
 #endif /* world_h */